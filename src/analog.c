@@ -0,0 +1,77 @@
+#include "analog.h"
+
+// The ADC free-runs in round-robin mode and one DMA channel streams its FIFO into the ring.
+// When the ring is full a second DMA channel rewrites the first one's write address, which
+// restarts it, so the CPU never touches the ADC after init.
+// The ring holds a whole number of rounds, so slot i always belongs to channel_order[i % channel_count].
+
+static uint16_t analog_ring[ANALOG_OVERSAMPLE * ANALOG_CHANNEL_COUNT];
+static uint16_t *analog_ring_start = analog_ring;
+
+static uint8_t channel_order[ANALOG_CHANNEL_COUNT];
+static uint8_t channel_count = 0;
+static uint16_t analog_values[ANALOG_CHANNEL_COUNT] = {0};
+
+static int data_channel = -1;
+static int control_channel = -1;
+
+void analog_init(uint8_t channel_mask) {
+    channel_count = 0;
+    for (uint8_t channel = 0; channel < ANALOG_CHANNEL_COUNT; ++channel) {
+        if (channel_mask & (1u << channel)) channel_order[channel_count++] = channel;
+    }
+    if (!channel_count) return;
+
+    adc_init();
+    for (int i = 0; i < channel_count; ++i) {
+        if (channel_order[i] < 4) adc_gpio_init(ANALOG_FIRST_PIN + channel_order[i]);
+    }
+
+    // round-robin walks the enabled channels upwards from the selected one
+    adc_select_input(channel_order[0]);
+    adc_set_round_robin(channel_mask & ((1u << ANALOG_CHANNEL_COUNT) - 1));
+    // FIFO with DREQ at one sample, no error bit, keep all 12 bits
+    adc_fifo_setup(true, true, 1, false, false);
+    adc_set_clkdiv(48000000.0f / ANALOG_SAMPLE_RATE_HZ - 1);
+
+    data_channel = dma_claim_unused_channel(true);
+    control_channel = dma_claim_unused_channel(true);
+
+    dma_channel_config c = dma_channel_get_default_config(data_channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, DREQ_ADC);
+    channel_config_set_chain_to(&c, control_channel);
+    dma_channel_configure(data_channel, &c, analog_ring, &adc_hw->fifo, ANALOG_OVERSAMPLE * channel_count, false);
+
+    c = dma_channel_get_default_config(control_channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, false);
+    dma_channel_configure(control_channel, &c, &dma_hw->ch[data_channel].al2_write_addr_trig, &analog_ring_start, 1,
+                          false);
+
+    dma_channel_start(data_channel);
+    adc_run(true);
+}
+
+// Decimates the ring into one oversampled value per channel, never waits on the ADC
+void analog_update(void) {
+    uint32_t sums[ANALOG_CHANNEL_COUNT] = {0};
+
+    uint8_t slot = 0;
+    for (int i = 0; i < ANALOG_OVERSAMPLE * channel_count; ++i) {
+        sums[slot] += analog_ring[i];
+        if (++slot == channel_count) slot = 0;
+    }
+
+    for (int i = 0; i < channel_count; ++i) {
+        analog_values[channel_order[i]] = (uint16_t) sums[i];
+    }
+}
+
+uint16_t analog_get(uint8_t channel) {
+    if (channel >= ANALOG_CHANNEL_COUNT) return 0;
+    return analog_values[channel];
+}
@@ -0,0 +1,26 @@
+#ifndef ANALOG
+#define ANALOG
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+
+// ADC inputs 0-3 are GPIO 26-29, 4 is the temperature sensor
+#define ANALOG_CHANNEL_COUNT 5
+#define ANALOG_FIRST_PIN 26
+
+// 12-bit samples summed per value, the sum of 16 fills 16 bits
+#define ANALOG_OVERSAMPLE 16
+#define ANALOG_MAX_VALUE (4095 * ANALOG_OVERSAMPLE)
+
+// Conversions per second across all enabled channels
+#define ANALOG_SAMPLE_RATE_HZ 96000
+
+void analog_init(uint8_t channel_mask);
+
+void analog_update(void);
+
+uint16_t analog_get(uint8_t channel);
+
+#endif //ANALOG
@@ -0,0 +1,75 @@
+#include "axis.h"
+
+// The M0+ has no divide instruction, so the only division happens in axis_configure().
+// Samples are then converted with a clamp, a 32x32 multiply and a shift.
+
+struct axis_state {
+    int32_t real_minimum;
+    int32_t real_maximum;
+    // values go from a larger number to a smaller number (e.g. 1024 to 0)
+    bool inverted;
+    // output units per input unit, 16.16 fixed point
+    uint32_t scale;
+    int16_t actual_minimum;
+    // NULL for constant axes, whose value is converted once
+    axis_source source;
+    uint8_t channel;
+    int32_t constant;
+    uint16_t value;
+};
+
+static struct axis_state axes_state[AXIS_ID_COUNT];
+
+static uint16_t axis_convert(const struct axis_state *state, int32_t value) {
+    if (value < state->real_minimum) value = state->real_minimum;
+    if (value > state->real_maximum) value = state->real_maximum;
+
+    uint32_t offset = state->inverted ? (uint32_t) (state->real_maximum - value) : (uint32_t) (value - state->real_minimum);
+    int32_t scaled = (int32_t) ((((uint64_t) offset * state->scale) + 0x8000) >> 16);
+
+    return (uint16_t) (int16_t) (state->actual_minimum + scaled);
+}
+
+void axis_configure(uint8_t axis, int32_t value_minimum, int32_t value_maximum, int16_t actual_minimum,
+                    int16_t actual_maximum) {
+    if (axis >= AXIS_ID_COUNT) return;
+
+    struct axis_state *state = &axes_state[axis];
+    state->inverted = value_minimum > value_maximum;
+    state->real_minimum = state->inverted ? value_maximum : value_minimum;
+    state->real_maximum = state->inverted ? value_minimum : value_maximum;
+    state->actual_minimum = actual_minimum;
+
+    uint32_t range = (uint32_t) (state->real_maximum - state->real_minimum);
+    uint32_t actual_range = (uint32_t) (actual_maximum - actual_minimum);
+    state->scale = range ? (uint32_t) (((uint64_t) actual_range << 16) / range) : 0;
+
+    state->value = axis_convert(state, state->constant);
+}
+
+void axis_set_source(uint8_t axis, axis_source source, uint8_t channel) {
+    if (axis >= AXIS_ID_COUNT) return;
+    axes_state[axis].source = source;
+    axes_state[axis].channel = channel;
+}
+
+void axis_set_constant(uint8_t axis, int32_t value) {
+    if (axis >= AXIS_ID_COUNT) return;
+
+    struct axis_state *state = &axes_state[axis];
+    state->source = NULL;
+    state->constant = value;
+    state->value = axis_convert(state, value);
+}
+
+// Converts every listed axis that has a source in one pass
+void axis_update(const uint8_t *axes, uint8_t count) {
+    for (int i = 0; i < count; ++i) {
+        struct axis_state *state = &axes_state[axes[i]];
+        if (state->source) state->value = axis_convert(state, state->source(state->channel));
+    }
+}
+
+uint16_t axis_get(uint8_t axis) {
+    return axes_state[axis].value;
+}
@@ -0,0 +1,36 @@
+#ifndef AXIS
+#define AXIS
+
+#include <stdio.h>
+#include <stdbool.h>
+
+enum axis_id {
+    axis_x = 0,
+    axis_y,
+    axis_z,
+    axis_rx,
+    axis_ry,
+    axis_rz,
+    axis_rudder,
+    axis_throttle,
+    axis_accelerator,
+    axis_brake,
+    axis_steering,
+    AXIS_ID_COUNT
+};
+
+// Reads the raw value of an axis, in the units of its configured range
+typedef int32_t (*axis_source)(uint8_t channel);
+
+void axis_configure(uint8_t axis, int32_t value_minimum, int32_t value_maximum, int16_t actual_minimum,
+                    int16_t actual_maximum);
+
+void axis_set_source(uint8_t axis, axis_source source, uint8_t channel);
+
+void axis_set_constant(uint8_t axis, int32_t value);
+
+void axis_update(const uint8_t *axes, uint8_t count);
+
+uint16_t axis_get(uint8_t axis);
+
+#endif //AXIS
@@ -0,0 +1,80 @@
+#include "cdc_tx.h"
+
+// Coalesces replies into full packets instead of sending one short packet per reply.
+// Everything runs on the CDC task, so the ring needs no locking.
+
+static uint8_t cdc_tx_queue[CDC_TX_QUEUE_SIZE];
+static uint32_t cdc_tx_head = 0;
+static uint32_t cdc_tx_tail = 0;
+// Time the oldest queued byte was written
+static uint32_t cdc_tx_oldest_us = 0;
+
+static inline uint32_t cdc_tx_used(void) {
+    return cdc_tx_head - cdc_tx_tail;
+}
+
+uint32_t cdc_tx_free(void) {
+    return CDC_TX_QUEUE_SIZE - cdc_tx_used();
+}
+
+// Queues all of data or none of it, callers check cdc_tx_free() first to hold off instead of dropping
+bool cdc_tx_write(const void *data, uint32_t length) {
+    if (length > cdc_tx_free()) return false;
+
+    if (!cdc_tx_used()) cdc_tx_oldest_us = time_us_32();
+
+    const uint8_t *bytes = data;
+    for (uint32_t i = 0; i < length; ++i) {
+        cdc_tx_queue[(cdc_tx_head + i) & (CDC_TX_QUEUE_SIZE - 1)] = bytes[i];
+    }
+    cdc_tx_head += length;
+    return true;
+}
+
+// Moves up to length queued bytes into the USB FIFO, returns how many it took
+static uint32_t cdc_tx_move(uint32_t length) {
+    uint32_t available = tud_cdc_write_available();
+    if (length > available) length = available;
+
+    uint32_t moved = 0;
+    while (moved < length) {
+        // the ring wraps at most once, so this writes one or two contiguous chunks
+        uint32_t index = (cdc_tx_tail + moved) & (CDC_TX_QUEUE_SIZE - 1);
+        uint32_t chunk = CDC_TX_QUEUE_SIZE - index;
+        if (chunk > length - moved) chunk = length - moved;
+
+        uint32_t written = tud_cdc_write(&cdc_tx_queue[index], chunk);
+        moved += written;
+        if (written < chunk) break;
+    }
+
+    cdc_tx_tail += moved;
+    return moved;
+}
+
+// idle says no more commands are waiting, so nothing else is coming to fill the packet
+void cdc_tx_task(bool idle) {
+    uint32_t used = cdc_tx_used();
+    if (!used) return;
+
+    // full packets go right away
+    uint32_t full = used - used % CDC_TX_PACKET_SIZE;
+    if (full) cdc_tx_move(full);
+
+    used = cdc_tx_used();
+    if (!used || (!idle && time_us_32() - cdc_tx_oldest_us < CDC_TX_FLUSH_DEADLINE_US)) return;
+
+    // the rest is all there is or has waited long enough, send it as a short packet
+    if (cdc_tx_move(used)) tud_cdc_write_flush();
+    if (cdc_tx_used()) cdc_tx_oldest_us = time_us_32();
+}
+
+// Sends everything queued before returning, for replies that have to be out before a reset
+void cdc_tx_flush_blocking(void) {
+    uint32_t start = time_us_32();
+    while (cdc_tx_used() && time_us_32() - start < CDC_TX_FLUSH_TIMEOUT_US) {
+        cdc_tx_move(cdc_tx_used());
+        tud_cdc_write_flush();
+        tud_task();
+    }
+}
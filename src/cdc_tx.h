@@ -0,0 +1,27 @@
+#ifndef CDC_TX
+#define CDC_TX
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "pico/time.h"
+#include "tusb.h"
+
+// Replies waiting for the USB FIFO, must be a power of 2
+#define CDC_TX_QUEUE_SIZE 1024
+// Bytes that make a full packet, sent as soon as they are queued
+#define CDC_TX_PACKET_SIZE CFG_TUD_CDC_EP_BUFSIZE
+// While commands keep arriving, a short packet goes out once its oldest byte has waited this long
+#define CDC_TX_FLUSH_DEADLINE_US 1000
+// Give up on a blocking flush when the host stops reading
+#define CDC_TX_FLUSH_TIMEOUT_US 100000
+
+uint32_t cdc_tx_free(void);
+
+bool cdc_tx_write(const void *data, uint32_t length);
+
+void cdc_tx_task(bool idle);
+
+void cdc_tx_flush_blocking(void);
+
+#endif //CDC_TX
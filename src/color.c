@@ -0,0 +1,55 @@
+#include "color.h"
+
+// Fully saturated hue wheel at half lightness, 0xRRGGBB, entry h is the old float hslToRGB(h / 255, 1, 0.5)
+const uint32_t hue_wheel[256] = {
+        0xFF0000, 0xFF0600, 0xFF0C00, 0xFF1200, 0xFF1800, 0xFF1E00, 0xFF2400, 0xFF2A00,
+        0xFF3000, 0xFF3600, 0xFF3C00, 0xFF4200, 0xFF4800, 0xFF4E00, 0xFF5400, 0xFF5A00,
+        0xFF6000, 0xFF6600, 0xFF6C00, 0xFF7200, 0xFF7800, 0xFF7E00, 0xFF8400, 0xFF8A00,
+        0xFF9000, 0xFF9600, 0xFF9C00, 0xFFA200, 0xFFA800, 0xFFAE00, 0xFFB400, 0xFFBA00,
+        0xFFC000, 0xFFC600, 0xFFCC00, 0xFFD200, 0xFFD800, 0xFFDE00, 0xFFE400, 0xFFEA00,
+        0xFFF000, 0xFFF600, 0xFFFC00, 0xFBFF00, 0xF5FF00, 0xEFFF00, 0xE9FF00, 0xE3FF00,
+        0xDDFF00, 0xD7FF00, 0xD1FF00, 0xCBFF00, 0xC5FF00, 0xBFFF00, 0xB9FF00, 0xB3FF00,
+        0xADFF00, 0xA7FF00, 0xA1FF00, 0x9BFF00, 0x95FF00, 0x8FFF00, 0x89FF00, 0x83FF00,
+        0x7DFF00, 0x77FF00, 0x71FF00, 0x6BFF00, 0x65FF00, 0x5FFF00, 0x59FF00, 0x53FF00,
+        0x4DFF00, 0x47FF00, 0x41FF00, 0x3BFF00, 0x35FF00, 0x2FFF00, 0x29FF00, 0x23FF00,
+        0x1DFF00, 0x17FF00, 0x11FF00, 0x0BFF00, 0x05FF00, 0x00FF00, 0x00FF05, 0x00FF0B,
+        0x00FF11, 0x00FF17, 0x00FF1D, 0x00FF23, 0x00FF29, 0x00FF2F, 0x00FF35, 0x00FF3B,
+        0x00FF41, 0x00FF47, 0x00FF4D, 0x00FF53, 0x00FF59, 0x00FF5F, 0x00FF65, 0x00FF6B,
+        0x00FF71, 0x00FF77, 0x00FF7D, 0x00FF83, 0x00FF89, 0x00FF8F, 0x00FF95, 0x00FF9B,
+        0x00FFA1, 0x00FFA7, 0x00FFAD, 0x00FFB3, 0x00FFB9, 0x00FFBF, 0x00FFC5, 0x00FFCB,
+        0x00FFD1, 0x00FFD7, 0x00FFDD, 0x00FFE3, 0x00FFE9, 0x00FFEF, 0x00FFF5, 0x00FFFB,
+        0x00FBFF, 0x00F5FF, 0x00EFFF, 0x00E9FF, 0x00E3FF, 0x00DDFF, 0x00D7FF, 0x00D1FF,
+        0x00CBFF, 0x00C5FF, 0x00BFFF, 0x00B9FF, 0x00B3FF, 0x00ADFF, 0x00A7FF, 0x00A1FF,
+        0x009BFF, 0x0095FF, 0x008FFF, 0x0089FF, 0x0083FF, 0x007DFF, 0x0077FF, 0x0071FF,
+        0x006BFF, 0x0065FF, 0x005FFF, 0x0059FF, 0x0053FF, 0x004DFF, 0x0047FF, 0x0041FF,
+        0x003BFF, 0x0035FF, 0x002FFF, 0x0029FF, 0x0023FF, 0x001DFF, 0x0017FF, 0x0011FF,
+        0x000BFF, 0x0005FF, 0x0000FF, 0x0600FF, 0x0B00FF, 0x1200FF, 0x1700FF, 0x1E00FF,
+        0x2300FF, 0x2A00FF, 0x2F00FF, 0x3600FF, 0x3B00FF, 0x4200FF, 0x4700FF, 0x4E00FF,
+        0x5300FF, 0x5A00FF, 0x5F00FF, 0x6600FF, 0x6B00FF, 0x7200FF, 0x7700FF, 0x7E00FF,
+        0x8300FF, 0x8A00FF, 0x8F00FF, 0x9600FF, 0x9B00FF, 0xA200FF, 0xA700FF, 0xAE00FF,
+        0xB300FF, 0xBA00FF, 0xBF00FF, 0xC600FF, 0xCB00FF, 0xD200FF, 0xD700FF, 0xDE00FF,
+        0xE300FF, 0xEA00FF, 0xEF00FF, 0xF600FF, 0xFB00FF, 0xFF00FC, 0xFF00F5, 0xFF00F0,
+        0xFF00E9, 0xFF00E4, 0xFF00DD, 0xFF00D8, 0xFF00D1, 0xFF00CC, 0xFF00C5, 0xFF00C0,
+        0xFF00B9, 0xFF00B4, 0xFF00AD, 0xFF00A8, 0xFF00A1, 0xFF009C, 0xFF0095, 0xFF0090,
+        0xFF0089, 0xFF0084, 0xFF007D, 0xFF0078, 0xFF0071, 0xFF006C, 0xFF0065, 0xFF0060,
+        0xFF0059, 0xFF0054, 0xFF004D, 0xFF0048, 0xFF0041, 0xFF003C, 0xFF0035, 0xFF0030,
+        0xFF0029, 0xFF0024, 0xFF001D, 0xFF0018, 0xFF0011, 0xFF000C, 0xFF0005, 0xFF0000,
+};
+
+// HSL with every component 0-255, within 1 of the float conversion and exact on the wheel
+uint32_t hsl_to_rgb(uint8_t h, uint8_t s, uint8_t l) {
+    uint32_t color = hue_wheel[h];
+    if (s == 0xFF && l == 0x80) return color;
+
+    // chroma is 2 * s * m and the darkest channel l - s * m, all in 1/255^2
+    int32_t m = l < 0xFF - l ? l : 0xFF - l;
+    int32_t base = l * 0xFF * 0xFF - s * m * 0xFF;
+    int32_t chroma = 2 * s * m;
+
+    uint32_t out = 0;
+    for (int shift = 16; shift >= 0; shift -= 8) {
+        int32_t channel = (base + chroma * (int32_t) ((color >> shift) & 0xFF)) / (0xFF * 0xFF);
+        out |= (uint32_t) channel << shift;
+    }
+    return out;
+}
@@ -0,0 +1,12 @@
+#ifndef COLOR
+#define COLOR
+
+#include <stdint.h>
+
+// Integer color helpers, kept free of pico headers so the host tests can build them
+
+extern const uint32_t hue_wheel[256];
+
+uint32_t hsl_to_rgb(uint8_t h, uint8_t s, uint8_t l);
+
+#endif //COLOR
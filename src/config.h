@@ -5,6 +5,9 @@
 
 #define BUTTON_COUNT 8
 #define HAT_COUNT 0
+// GPIO pins the buttons and hats are wired to, all of them are pulled up as inputs
+#define INPUT_PIN_FIRST 1
+#define INPUT_PIN_LAST 12
 
 #define HAS_X_AXIS false
 #define HAS_Y_AXIS false
@@ -19,4 +22,9 @@
 #define HAS_BRAKE false
 #define HAS_STEERING false
 
+#define LED_USE_CORE1 true
+
+#define HID_LOW_LATENCY true
+#define HID_IDLE_KEEPALIVE_MS 100
+
 #endif //CONFIG
@@ -1,6 +1,7 @@
 #ifndef COMMAND_PROTOCOL
 #define COMMAND_PROTOCOL
-#define COMMAND_PROTOCOL_VERSION 0x0100
+// From 0x0300 every command and reply is framed with a 16-bit big endian length, see framing.h
+#define COMMAND_PROTOCOL_VERSION 0x0300
 
 enum data_command_id {
     id_get_protocol_version = 0x01,
@@ -9,6 +10,17 @@ enum data_command_id {
     id_get_led_data = 0x04,
     id_get_led = 0x05,
     id_set_led = 0x06,
+    id_set_led_data = 0x07,
+    // followed by led count * 3 RGB bytes over as many packets as needed, no reply
+    id_stream_frame = 0x08,
+    id_set_timeline = 0x09,
+    // [count] then count times [selection][selection args][value][value data], applied together with one reply
+    // the reply is [count], or id_error then the first bad fill, 0xFF when the batch as a whole was refused
+    id_set_led_batch = 0x0A,
+    // run length and skip coded frame against the last streamed one, see led.c, no reply
+    id_stream_frame_compressed = 0x0B,
+    // streamed by the device after an id_get_controller_state subscription, never sent by the host
+    id_controller_state = 0x0C,
 
 
     //...
@@ -17,9 +29,12 @@ enum data_command_id {
     id_error = 0xFF
 };
 
+// LED indices are 16-bit big endian from protocol version 0x0200
 enum data_led_data {
     id_led_count = 0x01,
-    id_section_count = 0x02
+    id_section_count = 0x02,
+    id_section_layout = 0x03,
+    id_frame_timing = 0x04
 };
 
 enum data_lighting_selection {
@@ -37,5 +52,35 @@ enum data_lighting_value {
     id_led_speed = 0x05,
     id_led_brightness = 0x06
 };
+
+enum data_led_effect {
+    id_effect_static = 0x00,
+    id_effect_breathing_up = 0x01,
+    id_effect_breathing_down = 0x02,
+    id_effect_color_cycle = 0x03
+};
+
+enum data_timeline_value {
+    id_timeline_keyframe = 0x01,
+    id_timeline_length = 0x02,
+    id_timeline_play = 0x03,
+    id_timeline_stop = 0x04
+};
+
+enum data_timeline_easing {
+    id_easing_linear = 0x00,
+    id_easing_in = 0x01,
+    id_easing_out = 0x02,
+    id_easing_in_out = 0x03,
+    id_easing_step = 0x04
+};
+
+// Fields of a controller state record, in record order after [sequence u16][fields]
+enum data_state_field {
+    id_state_timestamp = 0x01, // u32 us
+    id_state_buttons = 0x02,   // u32, bit i is button i
+    id_state_axes = 0x04,      // [count] then count u16 in report order
+    id_state_encoders = 0x08   // [count] then count i32 raw quarter step counts
+};
 #endif //COMMAND_PROTOCOL
 
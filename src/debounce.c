@@ -0,0 +1,98 @@
+#include "debounce.h"
+
+// Every button is one bit in each mask, so a sample of all buttons costs a handful of word operations.
+// Only buttons that changed or are in hold-off are visited one by one.
+
+static uint32_t stable = 0;
+static uint32_t eager_mask = 0;
+static uint32_t integrating_mask = 0;
+
+// eager buttons ignoring their input until unlock_us
+static uint32_t locked = 0;
+static uint32_t unlock_us[DEBOUNCE_MAX_BUTTONS];
+static uint32_t hold_off_us[DEBOUNCE_MAX_BUTTONS];
+
+// vertical 2-bit counters of the integrating buttons, one bit plane each
+static uint32_t count_0 = ~0u;
+static uint32_t count_1 = ~0u;
+
+void debounce_init(void) {
+    stable = 0;
+    eager_mask = 0;
+    integrating_mask = 0;
+    locked = 0;
+    count_0 = ~0u;
+    count_1 = ~0u;
+
+    for (int i = 0; i < DEBOUNCE_MAX_BUTTONS; ++i) {
+        unlock_us[i] = 0;
+        hold_off_us[i] = DEBOUNCE_HOLD_OFF_US;
+    }
+}
+
+void debounce_configure(uint8_t button, enum debounce_mode mode, uint32_t button_hold_off_us) {
+    if (button >= DEBOUNCE_MAX_BUTTONS) return;
+
+    uint32_t bit = 1u << button;
+    eager_mask &= ~bit;
+    integrating_mask &= ~bit;
+    locked &= ~bit;
+
+    switch (mode) {
+        case debounce_eager: {
+            eager_mask |= bit;
+            break;
+        }
+
+        case debounce_integrating: {
+            integrating_mask |= bit;
+            break;
+        }
+
+        default: {
+            break;
+        }
+    }
+
+    hold_off_us[button] = button_hold_off_us;
+}
+
+// Feeds one sample of every button (bit set while pressed) and returns the debounced state
+uint32_t debounce_update(uint32_t raw, uint32_t now_us) {
+    uint32_t changed = raw ^ stable;
+
+    // buttons without debouncing follow the sample
+    uint32_t next = (stable & (eager_mask | integrating_mask)) | (raw & ~(eager_mask | integrating_mask));
+
+    // release eager buttons whose hold-off ran out
+    uint32_t pending = locked;
+    while (pending) {
+        uint8_t i = __builtin_ctz(pending);
+        pending &= pending - 1;
+        if ((int32_t) (now_us - unlock_us[i]) >= 0) locked &= ~(1u << i);
+    }
+
+    // eager: take the first edge immediately and lock out the bounce that follows
+    uint32_t edges = changed & eager_mask & ~locked;
+    next ^= edges;
+    locked |= edges;
+    while (edges) {
+        uint8_t i = __builtin_ctz(edges);
+        edges &= edges - 1;
+        unlock_us[i] = now_us + hold_off_us[i];
+    }
+
+    // integrating: counters count samples that differ from the stable state and reset when they agree
+    uint32_t toggle = changed & integrating_mask;
+    count_0 = ~(count_0 & toggle);
+    count_1 = count_0 ^ (count_1 & toggle);
+    toggle &= count_0 & count_1;
+    next ^= toggle;
+
+    stable = next;
+    return stable;
+}
+
+uint32_t debounce_get_state(void) {
+    return stable;
+}
@@ -0,0 +1,32 @@
+#ifndef DEBOUNCE
+#define DEBOUNCE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "config.h"
+
+// Default hold-off after an eager edge, long enough to cover the bounce of most switches
+#ifndef DEBOUNCE_HOLD_OFF_US
+#define DEBOUNCE_HOLD_OFF_US 5000
+#endif //DEBOUNCE_HOLD_OFF_US
+
+#define DEBOUNCE_MAX_BUTTONS 32
+
+enum debounce_mode {
+    // report the raw sample
+    debounce_none = 0,
+    // report the first edge right away, then ignore the button for its hold-off
+    debounce_eager = 1,
+    // report a change once 4 consecutive samples agree, for noisy switches
+    debounce_integrating = 2
+};
+
+void debounce_init(void);
+
+void debounce_configure(uint8_t button, enum debounce_mode mode, uint32_t hold_off_us);
+
+uint32_t debounce_update(uint32_t raw, uint32_t now_us);
+
+uint32_t debounce_get_state(void);
+
+#endif //DEBOUNCE
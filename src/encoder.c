@@ -1,84 +1,345 @@
 #include "encoder.h"
 
-static int16_t rotation = 0;
-static int16_t encoder_min = -255;
-static int16_t encoder_max = 255;
-
-static void pio_irq_handler() {
-    // test if irq 0 was raised
-    if (pio0_hw->irq & 1) {
-        rotation -= 1;
+static encoder encoders[ENCODER_MAX_COUNT];
+// encoder driven by each state machine, for the IRQ dispatch
+static encoder *sm_encoders[2][4] = {{NULL}};
+// the program has to sit at offset 0 for its jump table, so each PIO block holds one copy
+static bool program_loaded[2] = {false, false};
+
+#if ENCODER_USE_PIO_COUNTER
+#define encoder_program pio_rotary_encoder_counter_program
+#define encoder_program_get_default_config pio_rotary_encoder_counter_program_get_default_config
+#else
+#define encoder_program pio_rotary_encoder_program
+#define encoder_program_get_default_config pio_rotary_encoder_program_get_default_config
+#endif //ENCODER_USE_PIO_COUNTER
+
+const struct encoder_acceleration encoder_default_acceleration[4] = {
+        {0,  1},
+        {10, 2},
+        {25, 4},
+        {50, 8},
+};
+
+static void encoder_record_step(encoder *enc, uint32_t time_us, int32_t steps) {
+    struct encoder_step *step = &enc->history[enc->history_head & (ENCODER_HISTORY_LENGTH - 1)];
+    step->time_us = time_us;
+    step->steps = steps;
+    enc->history_head++;
+}
+
+#if !ENCODER_USE_PIO_COUNTER
+// step for each A'B'AB transition pushed by the state machine, clockwise counts down
+static const int8_t transition_steps[16] = {
+        0, -1, 1, 0,
+        1, 0, 0, -1,
+        -1, 0, 0, 1,
+        0, 1, -1, 0
+};
+
+static void encoder_irq_handler(PIO pio) {
+    encoder **pio_encoders = sm_encoders[pio_get_index(pio)];
+    for (int sm = 0; sm < 4; ++sm) {
+        encoder *enc = pio_encoders[sm];
+        if (!enc) continue;
+
+        if (pio_sm_is_rx_fifo_empty(pio, sm)) continue;
+
+        // publish count and history together, see encoder_get_count()
+        enc->sequence++;
+        __dmb();
+        while (!pio_sm_is_rx_fifo_empty(pio, sm)) {
+            int8_t step = transition_steps[pio_sm_get(pio, sm) & 0x0F];
+            enc->count += step;
+            encoder_record_step(enc, time_us_32(), step);
+        }
+        __dmb();
+        enc->sequence++;
     }
-    // test if irq 1 was raised
-    if (pio0_hw->irq & 2) {
-        rotation += 1;
+}
+
+static void pio0_irq_handler() {
+    encoder_irq_handler(pio0);
+}
+
+static void pio1_irq_handler() {
+    encoder_irq_handler(pio1);
+}
+#endif //!ENCODER_USE_PIO_COUNTER
+
+// claims a state machine on a PIO block that has, or can take, the encoder program
+static bool encoder_claim_sm(PIO pio, uint8_t *sm) {
+    int claimed = pio_claim_unused_sm(pio, false);
+    if (claimed < 0) return false;
+
+    uint index = pio_get_index(pio);
+    if (!program_loaded[index]) {
+        if (!pio_can_add_program(pio, &encoder_program)) {
+            pio_sm_unclaim(pio, claimed);
+            return false;
+        }
+
+        pio_add_program(pio, &encoder_program);
+        program_loaded[index] = true;
+
+#if !ENCODER_USE_PIO_COUNTER
+        irq_set_exclusive_handler(index ? PIO1_IRQ_0 : PIO0_IRQ_0, index ? pio1_irq_handler : pio0_irq_handler);
+        irq_set_enabled(index ? PIO1_IRQ_0 : PIO0_IRQ_0, true);
+#endif //!ENCODER_USE_PIO_COUNTER
     }
-    // clear both interrupts
-    pio0_hw->irq = 3;
+
+    *sm = claimed;
+    return true;
 }
 
-void encoder_init(uint8_t rotary_encoder_A, int16_t min_value, int16_t max_value, int16_t initial_value) {
-    uint8_t rotary_encoder_B = rotary_encoder_A + 1;
-    // pio 0 is used
+encoder *encoder_init(uint8_t rotary_encoder_A, int16_t min_value, int16_t max_value, int16_t initial_value) {
+    encoder *enc = NULL;
+    for (int i = 0; i < ENCODER_MAX_COUNT; ++i) {
+        if (!encoders[i].used) {
+            enc = &encoders[i];
+            break;
+        }
+    }
+    if (!enc) return NULL;
+
     PIO pio = pio0;
-    // state machine 0
-    uint8_t sm = 0;
+    uint8_t sm;
+    if (!encoder_claim_sm(pio, &sm)) {
+        pio = pio1;
+        if (!encoder_claim_sm(pio, &sm)) return NULL;
+    }
+
+#if ENCODER_USE_PIO_COUNTER
+    // the state machine drops a push when its FIFO is full, which would lose the newest count,
+    // so a channel has to keep the FIFO empty
+    int dma_channel = dma_claim_unused_channel(false);
+    if (dma_channel < 0) {
+        pio_sm_unclaim(pio, sm);
+        return NULL;
+    }
+#endif //ENCODER_USE_PIO_COUNTER
+
+    enc->used = true;
+    enc->pio = pio;
+    enc->sm = sm;
+    enc->max = max_value;
+    enc->min = min_value;
+    if (initial_value > enc->max) initial_value = enc->max;
+    if (initial_value < enc->min) initial_value = enc->min;
+    enc->position = initial_value;
+    enc->count = 0;
+    enc->sequence = 0;
+    enc->last_count = 0;
+    enc->partial_steps = 0;
+    enc->steps_per_detent = ENCODER_DEFAULT_STEPS_PER_DETENT;
+    enc->mode = encoder_clamp_mode;
+#if ENCODER_USE_PIO_COUNTER
+    enc->dma_channel = dma_channel;
+#else
+    enc->dma_channel = -1;
+#endif //ENCODER_USE_PIO_COUNTER
+    enc->history_head = 0;
+    for (int i = 0; i < ENCODER_HISTORY_LENGTH; ++i) {
+        enc->history[i].steps = 0;
+    }
+    encoder_set_acceleration(enc, encoder_default_acceleration, 4);
+
+    uint8_t rotary_encoder_B = rotary_encoder_A + 1;
     // configure the used pins as input with pull up
     pio_gpio_init(pio, rotary_encoder_A);
     gpio_set_pulls(rotary_encoder_A, true, false);
     pio_gpio_init(pio, rotary_encoder_B);
     gpio_set_pulls(rotary_encoder_B, true, false);
-    // load the pio program into the pio memory
-    uint offset = pio_add_program(pio, &pio_rotary_encoder_program);
-    // make a sm config
-    pio_sm_config c = pio_rotary_encoder_program_get_default_config(offset);
+    // make a sm config, the program is always at offset 0
+    pio_sm_config c = encoder_program_get_default_config(0);
     // set the 'in' pins
     sm_config_set_in_pins(&c, rotary_encoder_A);
     // set shift to left: bits shifted by 'in' enter at the least
     // significant bit (LSB), no autopush
     sm_config_set_in_shift(&c, false, false, 0);
-    // set the IRQ handler
-    irq_set_exclusive_handler(PIO0_IRQ_0, pio_irq_handler);
-    // enable the IRQ
-    irq_set_enabled(PIO0_IRQ_0, true);
-    pio0_hw->inte0 = PIO_IRQ0_INTE_SM0_BITS | PIO_IRQ0_INTE_SM1_BITS;
+    // each step is pushed to the RX FIFO, give it all 8 entries
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+
+    sm_encoders[pio_get_index(pio)][sm] = enc;
+
     // init the sm.
     // Note: the program starts after the jump table -> initial_pc = 16
     pio_sm_init(pio, sm, 16, &c);
+
+#if ENCODER_USE_PIO_COUNTER
+    // count from 0 and take the current pins as the previous value
+    pio_sm_exec(pio, sm, pio_encode_set(pio_x, 0));
+    pio_sm_exec(pio, sm, pio_encode_mov(pio_isr, pio_null));
+    pio_sm_exec(pio, sm, pio_encode_in(pio_pins, 2));
+    pio_sm_exec(pio, sm, pio_encode_mov(pio_y, pio_isr));
+
+    // keep the latest pushed count in memory, so reading it is a single load
+    dma_channel_config dc = dma_channel_get_default_config(dma_channel);
+    channel_config_set_transfer_data_size(&dc, DMA_SIZE_32);
+    channel_config_set_read_increment(&dc, false);
+    channel_config_set_write_increment(&dc, false);
+    channel_config_set_dreq(&dc, pio_get_dreq(pio, sm, false));
+    dma_channel_configure(dma_channel, &dc, &enc->count, &pio->rxf[sm], 0xFFFFFFFF, true);
+#else
+    pio_set_irq0_source_enabled(pio, pis_sm0_rx_fifo_not_empty + sm, true);
+#endif //ENCODER_USE_PIO_COUNTER
+
     // enable the sm
     pio_sm_set_enabled(pio, sm, true);
 
-    encoder_max = max_value;
-    encoder_min = min_value;
-    if (initial_value > encoder_max) initial_value = encoder_max;
-    if (initial_value < encoder_min) initial_value = encoder_max;
-    rotation = initial_value;
+    return enc;
+}
+
+// raw quarter step count, never torn by the IRQ or the DMA
+int32_t encoder_get_count(encoder *enc) {
+#if ENCODER_USE_PIO_COUNTER
+    // the DMA writes the whole word at once
+    return enc->count;
+#else
+    uint32_t sequence;
+    int32_t count;
+    do {
+        sequence = enc->sequence;
+        __dmb();
+        count = enc->count;
+        __dmb();
+    } while ((sequence & 1) || sequence != enc->sequence);
+    return count;
+#endif //ENCODER_USE_PIO_COUNTER
+}
+
+// brings position back into min/max, the writeback keeps a wound up position from hiding the next turn back
+static int16_t encoder_apply_mode(encoder *enc) {
+    if (enc->mode == encoder_wrap_mode) {
+        int32_t range = (int32_t) enc->max - enc->min + 1;
+        int32_t offset = (enc->position - enc->min) % range;
+        if (offset < 0) offset += range;
+        enc->position = enc->min + offset;
+    } else {
+        if (enc->position > enc->max) enc->position = enc->max;
+        if (enc->position < enc->min) enc->position = enc->min;
+    }
+    return (int16_t) enc->position;
+}
+
+void encoder_set_mode(encoder *enc, enum encoder_mode mode) {
+    enc->mode = mode;
+}
+
+void encoder_set_steps_per_detent(encoder *enc, uint8_t steps_per_detent) {
+    enc->steps_per_detent = steps_per_detent ? steps_per_detent : 1;
+    enc->partial_steps = 0;
+}
+
+void encoder_set_acceleration(encoder *enc, const struct encoder_acceleration *curve, uint8_t length) {
+    enc->acceleration = curve;
+    enc->acceleration_length = length;
+}
+
+// steps per second over the last ENCODER_VELOCITY_WINDOW_US, either direction
+uint32_t encoder_get_velocity(encoder *enc) {
+    uint32_t now = time_us_32();
+    uint32_t sequence;
+    uint32_t steps;
+
+    do {
+        sequence = enc->sequence;
+        __dmb();
+        steps = 0;
+
+        uint8_t head = enc->history_head;
+        for (int i = 1; i <= ENCODER_HISTORY_LENGTH; ++i) {
+            struct encoder_step *step = &enc->history[(uint8_t) (head - i) & (ENCODER_HISTORY_LENGTH - 1)];
+            if (!step->steps || now - step->time_us > ENCODER_VELOCITY_WINDOW_US) break;
+            steps += step->steps < 0 ? -step->steps : step->steps;
+        }
+
+        __dmb();
+    } while ((sequence & 1) || sequence != enc->sequence);
+
+    return steps * (1000000 / ENCODER_VELOCITY_WINDOW_US);
+}
+
+static uint8_t encoder_get_multiplier(encoder *enc) {
+    // the curve is in detents, like the multiplier it applies to
+    uint32_t velocity = encoder_get_velocity(enc) / enc->steps_per_detent;
+    uint8_t multiplier = 1;
+
+    for (int i = 0; i < enc->acceleration_length; ++i) {
+        if (velocity < enc->acceleration[i].velocity) break;
+        multiplier = enc->acceleration[i].multiplier;
+    }
+    return multiplier;
+}
+
+// folds the steps counted since the last call into the accelerated position
+void encoder_update(encoder *enc) {
+    int32_t count = encoder_get_count(enc);
+    // 32-bit difference, correct even when the raw count wraps
+    int32_t delta = (int32_t) ((uint32_t) count - (uint32_t) enc->last_count);
+    if (!delta) return;
+    enc->last_count = count;
+
+#if ENCODER_USE_PIO_COUNTER
+    // the state machine doesn't timestamp, so steps are stamped when they are seen
+    encoder_record_step(enc, time_us_32(), delta);
+#endif //ENCODER_USE_PIO_COUNTER
+
+    // only whole detents move the value, the rest waits for the next steps
+    enc->partial_steps += delta;
+    int32_t detents = enc->partial_steps / enc->steps_per_detent;
+    if (!detents) return;
+    enc->partial_steps -= detents * enc->steps_per_detent;
+
+    enc->position += detents * encoder_get_multiplier(enc);
+}
+
+// Encoder in slot index of the pool, NULL when that slot isn't used
+encoder *encoder_get(uint8_t index) {
+    if (index >= ENCODER_MAX_COUNT || !encoders[index].used) return NULL;
+    return &encoders[index];
+}
+
+void encoder_task(void) {
+    for (int i = 0; i < ENCODER_MAX_COUNT; ++i) {
+        if (!encoders[i].used) continue;
+        encoder_update(&encoders[i]);
+        encoder_apply_mode(&encoders[i]);
+    }
 }
 
 // set the current rotation to a specific value
-void encoder_set_rotation(int16_t _rotation) {
-    if (_rotation > encoder_max) _rotation = encoder_max;
-    if (_rotation < encoder_min) _rotation = encoder_max;
-    rotation = _rotation;
+void encoder_set_rotation(encoder *enc, int16_t _rotation) {
+    if (_rotation > enc->max) _rotation = enc->max;
+    if (_rotation < enc->min) _rotation = enc->min;
+    encoder_update(enc);
+    enc->position = _rotation;
+    // steps toward the old position don't count toward the first detent from the new one
+    enc->partial_steps = 0;
 }
 
 // get the current rotation
-int16_t encoder_get_rotation() {
-    return rotation;
+int16_t encoder_get_rotation(encoder *enc) {
+    encoder_update(enc);
+    return encoder_apply_mode(enc);
 }
 
-int16_t encoder_get_max() {
-    return encoder_max;
+int16_t encoder_get_max(encoder *enc) {
+    return enc->max;
 }
 
-int16_t encoder_get_min() {
-    return encoder_min;
+int16_t encoder_get_min(encoder *enc) {
+    return enc->min;
 }
 
-void inc_encoder() {
-    if (rotation < encoder_max) rotation += 1;
+void inc_encoder(encoder *enc) {
+    encoder_update(enc);
+    enc->position += 1;
+    encoder_apply_mode(enc);
 }
 
-void dec_encoder() {
-    if (rotation > encoder_min) rotation -= 1;
+void dec_encoder(encoder *enc) {
+    encoder_update(enc);
+    enc->position -= 1;
+    encoder_apply_mode(enc);
 }
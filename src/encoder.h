@@ -1,4 +1,3 @@
-
 #ifndef ENCODER
 #define ENCODER
 
@@ -6,22 +5,90 @@
 #include <pico/stdio.h>
 #include "hardware/pio.h"
 #include "hardware/irq.h"
+#include "hardware/dma.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
 #include "data_protocol.h"
 #include "generated/pio_rotary_encoder.pio.h"
 #include <math.h>
 
+// One state machine per encoder, spread over pio0 and pio1
+#define ENCODER_MAX_COUNT 8
+
+// Count steps inside the state machine instead of taking an interrupt per step
+#ifndef ENCODER_USE_PIO_COUNTER
+#define ENCODER_USE_PIO_COUNTER true
+#endif //ENCODER_USE_PIO_COUNTER
+
+// Step timestamps kept per encoder, must be a power of 2
+#define ENCODER_HISTORY_LENGTH 16
+// Steps within this window make up the velocity
+#define ENCODER_VELOCITY_WINDOW_US 100000
+// Quarter steps (A/B transitions) per mechanical detent
+#define ENCODER_DEFAULT_STEPS_PER_DETENT 4
+
+enum encoder_mode {
+    // stop at min/max
+    encoder_clamp_mode = 0,
+    // go from max back around to min
+    encoder_wrap_mode = 1
+};
+
+struct encoder_step {
+    uint32_t time_us;
+    int32_t steps;
+};
+
+// From velocity detents/s and up, each detent moves the value by multiplier
+struct encoder_acceleration {
+    uint16_t velocity;
+    uint8_t multiplier;
+};
+
 struct encoder {
-    int position;
+    // accelerated value in detents, brought back into min/max by the mode on every read
+    int32_t position;
+    // quarter steps since init, only ever written by the IRQ or mirrored from the state machine's X
+    volatile int32_t count;
+    // odd while the IRQ is updating count and history, readers retry until it is even and unchanged
+    volatile uint32_t sequence;
+    // count already folded into position
+    int32_t last_count;
+    // quarter steps not yet making up a whole detent
+    int32_t partial_steps;
+    uint8_t steps_per_detent;
+    enum encoder_mode mode;
+    // copies every pushed count into count, -1 when the IRQ counts instead
+    int dma_channel;
+    int16_t min;
+    int16_t max;
+    PIO pio;
+    uint8_t sm;
+    bool used;
+    struct encoder_step history[ENCODER_HISTORY_LENGTH];
+    volatile uint8_t history_head;
+    const struct encoder_acceleration *acceleration;
+    uint8_t acceleration_length;
 };
 
 typedef struct encoder encoder;
 
-void encoder_init(uint8_t rotary_encoder_A, int16_t min_value, int16_t max_value, int16_t initial_value);
-void encoder_set_rotation(int16_t _rotation);
-int16_t encoder_get_rotation();
-int16_t encoder_get_max();
-int16_t encoder_get_min();
-void inc_encoder();
-void dec_encoder();
+extern const struct encoder_acceleration encoder_default_acceleration[4];
+
+encoder *encoder_init(uint8_t rotary_encoder_A, int16_t min_value, int16_t max_value, int16_t initial_value);
+void encoder_set_rotation(encoder *enc, int16_t _rotation);
+int16_t encoder_get_rotation(encoder *enc);
+int16_t encoder_get_max(encoder *enc);
+int16_t encoder_get_min(encoder *enc);
+void inc_encoder(encoder *enc);
+void dec_encoder(encoder *enc);
+void encoder_set_acceleration(encoder *enc, const struct encoder_acceleration *curve, uint8_t length);
+void encoder_set_mode(encoder *enc, enum encoder_mode mode);
+void encoder_set_steps_per_detent(encoder *enc, uint8_t steps_per_detent);
+int32_t encoder_get_count(encoder *enc);
+uint32_t encoder_get_velocity(encoder *enc);
+void encoder_update(encoder *enc);
+encoder *encoder_get(uint8_t index);
+void encoder_task(void);
 
 #endif //ENCODER
@@ -0,0 +1,118 @@
+#include "framing.h"
+
+void frame_parser_init(struct frame_parser *parser, frame_read read, frame_handler handler, frame_ready ready,
+                       const struct frame_sink *sinks, uint8_t sink_count) {
+    parser->state = frame_length_high;
+    parser->length = 0;
+    parser->received = 0;
+    parser->read = read;
+    parser->handler = handler;
+    parser->ready = ready;
+    parser->sinks = sinks;
+    parser->sink_count = sink_count;
+    parser->sink = NULL;
+}
+
+static const struct frame_sink *frame_find_sink(struct frame_parser *parser, uint8_t id) {
+    for (int i = 0; i < parser->sink_count; ++i) {
+        if (parser->sinks[i].id == id) return &parser->sinks[i];
+    }
+    return NULL;
+}
+
+// Consumes everything the source has, handing over each frame as soon as it is complete
+void frame_parser_poll(struct frame_parser *parser) {
+    while (1) {
+        switch (parser->state) {
+            case frame_length_high:
+                // only start on a frame once its reply is sure to fit
+                if (parser->ready && !parser->ready()) return;
+                // fall through
+            case frame_length_low: {
+                uint8_t byte;
+                if (!parser->read(&byte, 1)) return;
+
+                if (parser->state == frame_length_high) {
+                    parser->length = byte << 8;
+                    parser->state = frame_length_low;
+                    break;
+                }
+
+                parser->length |= byte;
+                parser->received = 0;
+                if (!parser->length) {
+                    parser->handler(parser->buffer, 0);
+                    parser->state = frame_length_high;
+                    break;
+                }
+                parser->state = frame_id;
+                break;
+            }
+
+            case frame_id: {
+                if (!parser->read(&parser->buffer[0], 1)) return;
+                parser->received = 1;
+
+                parser->sink = frame_find_sink(parser, parser->buffer[0]);
+                if (parser->sink) {
+                    parser->state = parser->sink->begin(parser->length - 1) ? frame_sink : frame_discard;
+                } else {
+                    parser->state = parser->length > FRAME_MAX_LENGTH ? frame_discard : frame_payload;
+                }
+
+                if (parser->received == parser->length && parser->state != frame_discard) {
+                    if (parser->state == frame_payload) parser->handler(parser->buffer, parser->length);
+                    if (parser->state == frame_sink && parser->sink->end) parser->sink->end();
+                    parser->state = frame_length_high;
+                }
+                break;
+            }
+
+            case frame_payload: {
+                uint32_t count = parser->read(&parser->buffer[parser->received], parser->length - parser->received);
+                if (!count) return;
+
+                parser->received += count;
+                if (parser->received < parser->length) break;
+
+                parser->handler(parser->buffer, parser->length);
+                parser->state = frame_length_high;
+                break;
+            }
+
+            case frame_sink: {
+                uint32_t space;
+                uint8_t *window = parser->sink->window(&space);
+                if (space > (uint32_t) (parser->length - parser->received))
+                    space = parser->length - parser->received;
+
+                uint32_t count = parser->read(window, space);
+                if (!count) return;
+
+                parser->sink->advance(count);
+                parser->received += count;
+                if (parser->received < parser->length) break;
+
+                if (parser->sink->end) parser->sink->end();
+                parser->state = frame_length_high;
+                break;
+            }
+
+            case frame_discard: {
+                // the rest of a dropped frame is read over the start of the buffer, it is never handed out
+                uint32_t space = parser->length - parser->received;
+                if (space > FRAME_BUFFER_SIZE) space = FRAME_BUFFER_SIZE;
+
+                uint32_t count = parser->read(parser->buffer, space);
+                if (!count && parser->received < parser->length) return;
+
+                parser->received += count;
+                if (parser->received < parser->length) break;
+
+                parser->handler(parser->buffer, 0);
+                parser->state = frame_length_high;
+                break;
+            }
+        }
+    }
+}
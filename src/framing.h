@@ -0,0 +1,61 @@
+#ifndef FRAMING
+#define FRAMING
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Every command and reply is a 16-bit big endian payload length followed by the payload.
+// The parser keeps its state between polls, so frames can arrive split over packets or several to a packet.
+
+// Largest payload buffered for the handler, longer frames have to go to a sink
+#define FRAME_MAX_LENGTH 192
+// Room for the handler to write its reply over the request
+#define FRAME_BUFFER_SIZE 256
+
+typedef uint32_t (*frame_read)(void *buffer, uint32_t length);
+// Called with each complete payload, a length of 0 means a frame was dropped
+typedef void (*frame_handler)(uint8_t *payload, uint16_t length);
+// False holds off reading the next frame, so it waits in the source instead of being dropped
+typedef bool (*frame_ready)(void);
+
+// Takes the payload of frames starting with id straight from the source, without buffering it
+struct frame_sink {
+    uint8_t id;
+    // payload bytes after the id, false drops the frame
+    bool (*begin)(uint16_t length);
+    // where the next bytes go and how many fit there
+    uint8_t *(*window)(uint32_t *space);
+    void (*advance)(uint32_t bytes);
+    // the whole payload was received, may be NULL
+    void (*end)(void);
+};
+
+enum frame_parser_state {
+    frame_length_high = 0,
+    frame_length_low = 1,
+    frame_id = 2,
+    frame_payload = 3,
+    frame_sink = 4,
+    frame_discard = 5
+};
+
+struct frame_parser {
+    enum frame_parser_state state;
+    uint16_t length;
+    uint16_t received;
+    frame_read read;
+    frame_handler handler;
+    frame_ready ready;
+    const struct frame_sink *sinks;
+    uint8_t sink_count;
+    const struct frame_sink *sink;
+    uint8_t buffer[FRAME_BUFFER_SIZE];
+};
+
+void frame_parser_init(struct frame_parser *parser, frame_read read, frame_handler handler, frame_ready ready,
+                       const struct frame_sink *sinks, uint8_t sink_count);
+
+void frame_parser_poll(struct frame_parser *parser);
+
+#endif //FRAMING
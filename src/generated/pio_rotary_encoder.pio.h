@@ -19,18 +19,18 @@ static const uint16_t pio_rotary_encoder_program_instructions[] = {
             //     .wrap_target
     0x0011, //  0: jmp    17                         
     0x0015, //  1: jmp    21                         
-    0x0017, //  2: jmp    23                         
+    0x0015, //  2: jmp    21                         
     0x0011, //  3: jmp    17                         
-    0x0017, //  4: jmp    23                         
+    0x0015, //  4: jmp    21                         
     0x0011, //  5: jmp    17                         
     0x0011, //  6: jmp    17                         
     0x0015, //  7: jmp    21                         
     0x0015, //  8: jmp    21                         
     0x0011, //  9: jmp    17                         
     0x0011, // 10: jmp    17                         
-    0x0017, // 11: jmp    23                         
+    0x0015, // 11: jmp    21                         
     0x0011, // 12: jmp    17                         
-    0x0017, // 13: jmp    23                         
+    0x0015, // 13: jmp    21                         
     0x0015, // 14: jmp    21                         
     0x0011, // 15: jmp    17                         
     0x4002, // 16: in     pins, 2                    
@@ -38,9 +38,9 @@ static const uint16_t pio_rotary_encoder_program_instructions[] = {
     0x60c2, // 18: out    isr, 2                     
     0x4002, // 19: in     pins, 2                    
     0xa086, // 20: mov    exec, isr                  
-    0xc000, // 21: irq    nowait 0                   
-    0x0011, // 22: jmp    17                         
-    0xc001, // 23: irq    nowait 1                   
+    0xa046, // 21: mov    y, isr                     
+    0x8000, // 22: push   noblock                    
+    0xa0c2, // 23: mov    isr, y                     
             //     .wrap
 };
 
@@ -58,3 +58,57 @@ static inline pio_sm_config pio_rotary_encoder_program_get_default_config(uint o
 }
 #endif
 
+
+// -------------------------- //
+// pio_rotary_encoder_counter //
+// -------------------------- //
+
+#define pio_rotary_encoder_counter_wrap_target 0
+#define pio_rotary_encoder_counter_wrap 27
+
+static const uint16_t pio_rotary_encoder_counter_program_instructions[] = {
+            //     .wrap_target
+    0x0010, //  0: jmp    16                         
+    0x0019, //  1: jmp    25                         
+    0x0015, //  2: jmp    21                         
+    0x0010, //  3: jmp    16                         
+    0x0015, //  4: jmp    21                         
+    0x0010, //  5: jmp    16                         
+    0x0010, //  6: jmp    16                         
+    0x0019, //  7: jmp    25                         
+    0x0019, //  8: jmp    25                         
+    0x0010, //  9: jmp    16                         
+    0x0010, // 10: jmp    16                         
+    0x0015, // 11: jmp    21                         
+    0x0010, // 12: jmp    16                         
+    0x0015, // 13: jmp    21                         
+    0x0019, // 14: jmp    25                         
+    0x0010, // 15: jmp    16                         
+    0xa0c3, // 16: mov    isr, null                  
+    0x4042, // 17: in     y, 2                       
+    0x4002, // 18: in     pins, 2                    
+    0xa046, // 19: mov    y, isr                     
+    0xa086, // 20: mov    exec, isr                  
+    0xa029, // 21: mov    x, ~x                      
+    0x0057, // 22: jmp    x--, 23                    
+    0xa029, // 23: mov    x, ~x                      
+    0x001a, // 24: jmp    26                         
+    0x005a, // 25: jmp    x--, 26                    
+    0xa0c1, // 26: mov    isr, x                     
+    0x8000, // 27: push   noblock                    
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program pio_rotary_encoder_counter_program = {
+    .instructions = pio_rotary_encoder_counter_program_instructions,
+    .length = 28,
+    .origin = 0,
+};
+
+static inline pio_sm_config pio_rotary_encoder_counter_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + pio_rotary_encoder_counter_wrap_target, offset + pio_rotary_encoder_counter_wrap);
+    return c;
+}
+#endif
@@ -72,7 +72,7 @@ static inline void ws2812_program_init(PIO pio, uint sm, uint offset, uint pin,
 
 static const uint16_t ws2812_parallel_program_instructions[] = {
             //     .wrap_target
-    0x6020, //  0: out    x, 32                      
+    0x6028, //  0: out    x, 8                       
     0xa10b, //  1: mov    pins, !null            [1] 
     0xa401, //  2: mov    pins, x                [4] 
     0xa103, //  3: mov    pins, null             [1] 
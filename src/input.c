@@ -1,239 +1,251 @@
 #include "input.h"
 
 
-static long map(long x, long in_min, long in_max, long out_min, long out_max) {
-    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
-}
-
-static int16_t min(short a, short b) {
-    return b >= a ? a : b;
-}
-
-static int16_t max(int16_t a, int16_t b) {
-    return a < b ? b : a;
-}
-
-int16_t encode_16_bit_value(int16_t value, int16_t valueMinimum, int16_t valueMaximum, int16_t actualMinimum, int16_t actualMaximum) {
-    int16_t convertedValue;
-    int16_t realMinimum = min(valueMinimum, valueMaximum);
-    int16_t realMaximum = max(valueMinimum, valueMaximum);
-
-    if (value < realMinimum) {
-        value = realMinimum;
-    }
-    if (value > realMaximum) {
-        value = realMaximum;
-    }
-
-    if (valueMinimum > valueMaximum) {
-        // Values go from a larger number to a smaller number (e.g. 1024 to 0)
-        value = realMaximum - value + realMinimum;
-    }
-
-    convertedValue = map(value, realMinimum, realMaximum, actualMinimum, actualMaximum);
-
-    return convertedValue;
-}
-
-
-bool get_button(uint8_t button);
-uint8_t get_hat_1();
-uint8_t get_hat_2();
-uint16_t get_x_axis();
-uint16_t get_y_axis();
-uint16_t get_z_axis();
-uint16_t get_rx_axis();
-uint16_t get_ry_axis();
-uint16_t get_rz_axis();
-uint16_t get_rudder();
-uint16_t get_throttle();
-uint16_t get_accelerator();
-uint16_t get_brake();
-uint16_t get_steering();
-
-void update_report(uint8_t *report) {
-    uint8_t report_index = 0;
-#if BUTTON_COUNT
-    for (int i = 0; i < BUTTON_COUNT; ++i) {
-        if (!(i % 8) && (i > 0)) report_index += 1;
-        report[report_index] |= get_button(i) << (i % 8);
-    }
-#endif //BUTTON_COUNT
-
-#if HAT_COUNT
-    report_index += 1;
-    report[report_index] |= (get_hat_1() << 4);
-#if HAT_COUNT > 1
-    report[report_index] |= (get_hat_2() & 0x0F);
-#endif //HAT_COUNT > 1
-#endif //HAT_COUNT
-
+uint8_t get_hat_1(uint32_t pins);
+uint8_t get_hat_2(uint32_t pins);
+
+// ADC channel (0-3 on GPIO 26-29) feeding each axis, -1 keeps the axis on its default source
+static const int8_t axis_adc_channels[AXIS_ID_COUNT] = {
+        -1, // x
+        -1, // y
+        -1, // z
+        -1, // rx
+        -1, // ry
+        -1, // rz
+        -1, // rudder
+        -1, // throttle
+        -1, // accelerator
+        -1, // brake
+        -1, // steering
+};
+
+#define REPORT_AXIS_COUNT (AXIS_COUNT + SIMULATION_COUNT)
+
+#if REPORT_AXIS_COUNT
+// Axes in report order
+static const uint8_t report_axes[] = {
 #if HAS_X_AXIS
-    report_index += 1;
-    report[report_index] = get_x_axis() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_x_axis() >> 8;
+        axis_x,
 #endif //HAS_X_AXIS
 #if HAS_Y_AXIS
-    report_index += 1;
-    report[report_index] = get_y_axis() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_y_axis() >> 8;
+        axis_y,
 #endif //HAS_Y_AXIS
 #if HAS_Z_AXIS
-    report_index += 1;
-    report[report_index] = get_z_axis() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_z_axis() >> 8;
+        axis_z,
 #endif //HAS_Z_AXIS
 #if HAS_RX_AXIS
-    report_index += 1;
-    report[report_index] = get_rx_axis() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_rx_axis() >> 8;
+        axis_rx,
 #endif //HAS_RX_AXIS
 #if HAS_RY_AXIS
-    report_index += 1;
-    report[report_index] = get_ry_axis() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_ry_axis() >> 8;
+        axis_ry,
 #endif //HAS_RY_AXIS
 #if HAS_RZ_AXIS
-    report_index += 1;
-    report[report_index] = get_rz_axis() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_rz_axis() >> 8;
+        axis_rz,
 #endif //HAS_RZ_AXIS
-
 #if HAS_RUDDER
-    report_index += 1;
-    report[report_index] = get_rudder() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_rudder() >> 8;
+        axis_rudder,
 #endif //HAS_RUDDER
 #if HAS_THROTTLE
-    report_index += 1;
-    report[report_index] = get_throttle() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_throttle() >> 8;
+        axis_throttle,
 #endif //HAS_THROTTLE
 #if HAS_ACCELERATOR
-    report_index += 1;
-    report[report_index] = get_accelerator() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_accelerator() >> 8;
+        axis_accelerator,
 #endif //HAS_ACCELERATOR
 #if HAS_BRAKE
-    report_index += 1;
-    report[report_index] = get_brake() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_brake() >> 8;
+        axis_brake,
 #endif //HAS_BRAKE
 #if HAS_STEERING
-    report_index += 1;
-    report[report_index] = get_steering() & 0xFF;
-    report_index += 1;
-    report[report_index] = get_steering() >> 8;
+        axis_steering,
 #endif //HAS_STEERING
+};
+#endif //REPORT_AXIS_COUNT
+
+#if BUTTON_COUNT
+// GPIO pin of each button, in report order
+static const uint8_t button_pins[BUTTON_COUNT] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+// Debouncing of each button, in report order
+static const struct {
+    enum debounce_mode mode;
+    uint32_t hold_off_us;
+} button_debounce[BUTTON_COUNT] = {
+        {debounce_eager, DEBOUNCE_HOLD_OFF_US},
+        {debounce_eager, DEBOUNCE_HOLD_OFF_US},
+        {debounce_eager, DEBOUNCE_HOLD_OFF_US},
+        {debounce_eager, DEBOUNCE_HOLD_OFF_US},
+        {debounce_eager, DEBOUNCE_HOLD_OFF_US},
+        {debounce_eager, DEBOUNCE_HOLD_OFF_US},
+        {debounce_eager, DEBOUNCE_HOLD_OFF_US},
+        {debounce_eager, DEBOUNCE_HOLD_OFF_US},
+};
+
+// Buttons on consecutive pins are packed together with a single mask and shift
+struct button_run {
+    uint32_t mask;
+    int8_t shift;
+};
+
+static struct button_run button_runs[BUTTON_COUNT];
+static uint8_t button_run_count = 0;
+
+static void build_button_runs() {
+    button_run_count = 0;
+    for (int i = 0; i < BUTTON_COUNT; ++i) {
+        if (i > 0 && button_pins[i] == button_pins[i - 1] + 1) {
+            button_runs[button_run_count - 1].mask |= 1u << button_pins[i];
+            continue;
+        }
+
+        button_runs[button_run_count].mask = 1u << button_pins[i];
+        button_runs[button_run_count].shift = (int8_t) (button_pins[i] - i);
+        button_run_count++;
+    }
 }
 
-static inline void init_pin(uint8_t pin) {
-    gpio_set_dir(pin, false);
-    gpio_set_pulls(pin, true, false);
+// Bit i is set while button i is pressed
+static uint32_t get_buttons(uint32_t pins) {
+    uint32_t buttons = 0;
+    for (int i = 0; i < button_run_count; ++i) {
+        uint32_t bits = pins & button_runs[i].mask;
+        buttons |= button_runs[i].shift >= 0 ? bits >> button_runs[i].shift : bits << -button_runs[i].shift;
+    }
+    return buttons;
 }
+#endif //BUTTON_COUNT
 
-void input_init() {
-    init_pin(1);
-    init_pin(2);
-    init_pin(3);
-    init_pin(4);
-    init_pin(5);
-    init_pin(6);
-    init_pin(7);
-    init_pin(8);
-    init_pin(9);
-    init_pin(10);
-    init_pin(11);
-    init_pin(12);
-
-    // encoder_init(20, -255, 255, 0);
+// Latest coherent sample of every pin, active low pins read as 1 while pressed
+static uint32_t pins = 0;
+
+// Samples the inputs, runs at a fixed period so the debounce windows are in real time
+void input_task(void) {
+    pins = ~gpio_get_all();
+
+#if BUTTON_COUNT
+    debounce_update(get_buttons(pins), time_us_32());
+#endif //BUTTON_COUNT
+
+    analog_update();
 }
 
-static inline bool pin_get(uint8_t pin) {
-    return !gpio_get(pin);
+// Debounced buttons, bit i is button i
+uint32_t input_get_buttons(void) {
+#if BUTTON_COUNT
+    return debounce_get_state();
+#else
+    return 0;
+#endif //BUTTON_COUNT
 }
 
-bool get_button(uint8_t button) {
-    switch (button) {
-        case 0:
-            return pin_get(1);
-        case 1:
-            return pin_get(2);
-        case 2:
-            return pin_get(3);
-        case 3:
-            return pin_get(4);
-        case 4:
-            return pin_get(5);
-        case 5:
-            return pin_get(6);
-        case 6:
-            return pin_get(7);
-        case 7:
-            return pin_get(8);
-        default:
-            return 0;
+// Axes in report order, converted from their sources on each call rather than taken from the last HID report,
+// returns how many were written
+uint8_t input_get_axes(uint16_t *axes) {
+#if REPORT_AXIS_COUNT
+    // the HID path only converts them when it sends a report, which may be slower than the caller or not at all
+    axis_update(report_axes, REPORT_AXIS_COUNT);
+    for (int i = 0; i < REPORT_AXIS_COUNT; ++i) {
+        axes[i] = axis_get(report_axes[i]);
     }
+#else
+    (void) axes;
+#endif //REPORT_AXIS_COUNT
+    return REPORT_AXIS_COUNT;
 }
 
-uint8_t get_hat_1() {
-    return pin_get(1)*8;
+static inline uint8_t put_axis(uint8_t *report, uint8_t report_index, uint16_t value) {
+    report[report_index] = value & 0xFF;
+    report[report_index + 1] = value >> 8;
+    return report_index + 2;
 }
 
-uint8_t get_hat_2() {
-    return pin_get(2)*8;
-}
+void update_report(uint8_t *report) {
+    uint8_t report_index = 0;
 
-uint16_t get_x_axis() {
-    return encode_16_bit_value(encoder_get_rotation(), encoder_get_min(), encoder_get_max(), -32767, 32767);
-}
+#if BUTTON_COUNT
+    uint32_t buttons = debounce_get_state();
+    for (int i = 0; i < (BUTTON_COUNT + BUTTON_PADDING) / 8; ++i) {
+        report[report_index++] = (buttons >> (i * 8)) & 0xFF;
+    }
+#endif //BUTTON_COUNT
 
-uint16_t get_y_axis() {
-    return encode_16_bit_value(4, 0, 8, -32767, 32767);
-}
+#if HAT_COUNT
+    report[report_index] |= (get_hat_1(pins) << 4);
+#if HAT_COUNT > 1
+    report[report_index] |= (get_hat_2(pins) & 0x0F);
+#endif //HAT_COUNT > 1
+    report_index += 1;
+#endif //HAT_COUNT
 
-uint16_t get_z_axis() {
-    return encode_16_bit_value(-1, -1, 1, -32767, 32767);
+#if REPORT_AXIS_COUNT
+    axis_update(report_axes, REPORT_AXIS_COUNT);
+    for (int i = 0; i < REPORT_AXIS_COUNT; ++i) {
+        report_index = put_axis(report, report_index, axis_get(report_axes[i]));
+    }
+#endif //REPORT_AXIS_COUNT
+    (void) report_index;
 }
 
-uint16_t get_rx_axis() {
-    return encode_16_bit_value(0, -1, 1, -32767, 32767);
-}
+// NULL until an encoder is wired, the x axis then stays centered
+static encoder *x_encoder = NULL;
 
-uint16_t get_ry_axis() {
-    return encode_16_bit_value(0, -1, 1, -32767, 32767);
+static int32_t read_encoder(uint8_t channel) {
+    (void) channel;
+    return x_encoder ? encoder_get_rotation(x_encoder) : 0;
 }
 
-uint16_t get_rz_axis() {
-    return encode_16_bit_value(0, -1, 1, -32767, 32767);
+static int32_t read_analog(uint8_t channel) {
+    return analog_get(channel);
 }
 
-uint16_t get_rudder() {
-    return encode_16_bit_value(0, -1, 1, -32767, 32767);
+static inline void init_pin(uint8_t pin) {
+    gpio_set_dir(pin, false);
+    gpio_set_pulls(pin, true, false);
 }
 
-uint16_t get_throttle() {
-    return encode_16_bit_value(0, -1, 1, -32767, 32767);
-}
+void input_init() {
+    for (uint8_t pin = INPUT_PIN_FIRST; pin <= INPUT_PIN_LAST; ++pin) {
+        init_pin(pin);
+    }
+
+#if BUTTON_COUNT
+    build_button_runs();
+
+    debounce_init();
+    for (int i = 0; i < BUTTON_COUNT; ++i) {
+        debounce_configure(i, button_debounce[i].mode, button_debounce[i].hold_off_us);
+    }
+#endif //BUTTON_COUNT
+
+    // x_encoder = encoder_init(20, -255, 255, 0);
+
+    axis_configure(axis_x, -255, 255, -32767, 32767);
+    axis_set_source(axis_x, read_encoder, 0);
 
-uint16_t get_accelerator() {
-    return encode_16_bit_value(0, -1, 1, -32767, 32767);
+    axis_configure(axis_y, 0, 8, -32767, 32767);
+    axis_set_constant(axis_y, 4);
+
+    axis_configure(axis_z, -1, 1, -32767, 32767);
+    axis_set_constant(axis_z, -1);
+
+    for (uint8_t axis = axis_rx; axis < AXIS_ID_COUNT; ++axis) {
+        axis_configure(axis, -1, 1, -32767, 32767);
+        axis_set_constant(axis, 0);
+    }
+
+    uint8_t adc_channel_mask = 0;
+    for (uint8_t axis = 0; axis < AXIS_ID_COUNT; ++axis) {
+        if (axis_adc_channels[axis] < 0) continue;
+
+        adc_channel_mask |= 1u << axis_adc_channels[axis];
+        axis_configure(axis, 0, ANALOG_MAX_VALUE, -32767, 32767);
+        axis_set_source(axis, read_analog, axis_adc_channels[axis]);
+    }
+    analog_init(adc_channel_mask);
 }
 
-uint16_t get_brake() {
-    return encode_16_bit_value(0, -1, 1, -32767, 32767);
+uint8_t get_hat_1(uint32_t pins) {
+    return ((pins >> 1) & 1) * 8;
 }
 
-uint16_t get_steering() {
-    return encode_16_bit_value(0, -1, 1, -32767, 32767);
+uint8_t get_hat_2(uint32_t pins) {
+    return ((pins >> 2) & 1) * 8;
 }
@@ -6,12 +6,20 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <hardware/gpio.h>
+#include "pico/time.h"
 #include "encoder.h"
+#include "debounce.h"
+#include "axis.h"
+#include "analog.h"
 
 #ifndef BUTTON_COUNT
 #define BUTTON_COUNT 0
 #endif //BUTTON_COUNT
 
+#if BUTTON_COUNT > 32
+#error "Buttons are packed from a single 32-bit GPIO snapshot, BUTTON_COUNT must be 32 or less"
+#endif //BUTTON_COUNT > 32
+
 #if BUTTON_COUNT % 8
 #define BUTTON_PADDING (8 - (BUTTON_COUNT % 8))
 #else
@@ -126,5 +134,8 @@
 
 
 void input_init();
+void input_task(void);
 void update_report(uint8_t *report);
+uint32_t input_get_buttons(void);
+uint8_t input_get_axes(uint16_t *axes);
 #endif //INPUT
@@ -18,10 +18,74 @@ static const uint8_t led_gamma[] = { // Brightness ramp for LEDs
         179, 182, 184, 186, 188, 190, 193, 195, 197, 200, 202, 204, 207, 209, 211, 214,
         216, 219, 221, 223, 226, 228, 231, 234, 236, 239, 241, 244, 247, 249, 252, 255};
 
+// Gamma corrected output for every value at one LED brightness, scaled by the global brightness
+struct brightness_lut {
+    uint8_t lut[256];
+    uint8_t brightness;
+    bool used;
+};
+
+static struct brightness_lut brightness_luts[BRIGHTNESS_LUT_COUNT];
+// Table for each LED brightness, NULL when that brightness is scaled directly
+static const uint8_t *brightness_lut_for[256] = {NULL};
+// An LED brightness changed, the tables are matched to the values in use before the next render
+static bool brightness_luts_dirty = true;
+// Global brightness the tables were built with
+static uint8_t brightness_lut_global = 0xFF;
+static volatile uint8_t global_brightness = 0xFF;
+
 // WS2812
 
-static inline void put_pixel(uint32_t pixel_grb) {
-    pio_sm_put_blocking(pio1, 0, pixel_grb << 8u);
+static PIO led_pio = pio1;
+static uint led_sm = 0;
+static int led_dma_channel = -1;
+
+// Every per LED buffer is carved from here whenever the LED count changes
+static uint32_t led_arena[LED_ARENA_SIZE / sizeof(uint32_t)];
+
+// LEDs on each strip, LED i is at i % strip_length on strip i / strip_length
+static uint16_t strip_length = 0;
+// DMA words in one frame
+// a single strip takes packed GRB words, already shifted into the top 24 bits the PIO shifts out first,
+// parallel strips take one byte per bit time with bit s driving strip s, 24 of them per LED position in 6 words
+static uint32_t frame_words = 0;
+// Front/back pair of DMA words
+static uint32_t *LED_FRAME_BUFFER[2] = {NULL, NULL};
+static uint8_t front_frame = 0;
+// Back frame is rendered and waiting for the front one to finish
+static bool back_frame_ready = false;
+// Set while the DMA is feeding the PIO or the strip is latching, cleared by the reset alarm
+static volatile bool frame_in_flight = false;
+// No alarm slot was free for the latch, frame_in_flight is cleared by the first check after this time
+static volatile bool frame_latch_pending = false;
+static volatile uint32_t frame_latch_us = 0;
+// Start of the last frame sent, for the periodic refresh
+static uint32_t last_frame_us = 0;
+
+static int64_t ws2812_reset_complete(alarm_id_t id, void *user_data) {
+    (void) id;
+    (void) user_data;
+    frame_in_flight = false;
+    return 0;
+}
+
+static void ws2812_dma_irq_handler() {
+    if (!dma_channel_get_irq0_status(led_dma_channel)) return;
+    dma_channel_acknowledge_irq0(led_dma_channel);
+    // the last words are still in the FIFO, wait for them and the latch before allowing a new frame
+    if (add_alarm_in_us(WS2812_RESET_US, ws2812_reset_complete, NULL, true) < 0) {
+        frame_latch_us = time_us_32() + WS2812_RESET_US;
+        frame_latch_pending = true;
+    }
+}
+
+// Whether the strip is still busy with the last frame
+static bool led_frame_busy(void) {
+    if (frame_latch_pending && (int32_t) (time_us_32() - frame_latch_us) >= 0) {
+        frame_latch_pending = false;
+        frame_in_flight = false;
+    }
+    return frame_in_flight;
 }
 
 static inline uint32_t urgb_u32(uint8_t r, uint8_t g, uint8_t b) {
@@ -31,242 +95,1101 @@ static inline uint32_t urgb_u32(uint8_t r, uint8_t g, uint8_t b) {
             (uint32_t) (b);
 }
 
-static float hueToRGB(float p, float q, float t) {
-    if (t < 0) t += 1;
-    if (t > 1) t -= 1;
-    if (t < (float) 1 / 6) return p + (q - p) * 6 * t;
-    if (t < (float) 1 / 2) return q;
-    if (t < (float) 2 / 3) return p + (q - p) * ((float) 2 / 3 - t) * 6;
-    return p;
+// Per LED state, one array per field so each effect loop only touches what it reads
+static struct {
+    // LEDs the renderer is working with, the producer side validates against led_count
+    uint16_t count;
+    uint8_t *base_r;
+    uint8_t *base_g;
+    uint8_t *base_b;
+    uint8_t *out_r;
+    uint8_t *out_g;
+    uint8_t *out_b;
+    uint8_t *effect;
+    uint8_t *phase;
+    uint8_t *speed;
+    uint8_t *brightness;
+} leds;
+
+// LED count seen by the command side, already includes counts still waiting in the queue
+static uint16_t led_count = 0;
+// Resizes queued by the command side and applied by the renderer, equal once no resize is in the queue
+static uint32_t led_layout_requested = 0;
+static volatile uint32_t led_layout_applied = 0;
+
+struct led_section {
+    uint16_t start_led;
+    uint16_t end_led;
+};
+
+static struct led_section sections[SECTION_MAX_COUNT] = {
+        {0,  9},
+        {10, 14},
+        {15, 24},
+        {25, 29},
+        {30, 35},
+        {36, 41},
+        {30, 41},
+        {0,  29},
+};
+static uint8_t section_count = SECTION_DEFAULT_COUNT;
+
+// Time spent on the effects and the frame render of the last frame
+static volatile uint32_t effect_time_us = 0;
+static volatile uint32_t render_time_us = 0;
+
+
+// Effects
+// Each effect renders a whole run of LEDs, step is set on the frames the run's phase advances
+
+struct effect_run;
+typedef void (*effect)(const struct effect_run *run, bool step);
+
+// Consecutive LEDs evaluated by the same effect at the same speed
+struct effect_run {
+    uint16_t start;
+    uint16_t end;
+    // index into effect_table rather than the function, keeps a run at 6 bytes
+    uint8_t effect;
+    uint8_t speed;
+};
+
+// Nothing reads the phase of a static LED, setting an effect resets it, so it isn't advanced
+void effect_static(const struct effect_run *run, bool step) {
+    (void) step;
+    for (int i = run->start; i <= run->end; ++i) {
+        leds.out_r[i] = leds.base_r[i];
+        leds.out_g[i] = leds.base_g[i];
+        leds.out_b[i] = leds.base_b[i];
+    }
 }
 
-static uint32_t hslToRGB(float h, float s, float l) {
-    float r, g, b;
+// Breathing up and down share a run, an LED flips between the two at the end of each ramp
+void effect_breathing(const struct effect_run *run, bool step) {
+    for (int i = run->start; i <= run->end; ++i) {
+        uint multiplier = leds.effect[i] == id_effect_breathing_up ? leds.phase[i] : 0xFF - leds.phase[i];
+
+        leds.out_r[i] = (uint8_t) ((leds.base_r[i] * multiplier) / 0xFF);
+        leds.out_g[i] = (uint8_t) ((leds.base_g[i] * multiplier) / 0xFF);
+        leds.out_b[i] = (uint8_t) ((leds.base_b[i] * multiplier) / 0xFF);
 
-    if (s == 0) {
-        r = g = b = l; // achromatic
-    } else {
-        float q = (l < 0.5) ? l * (1 + s) : l + s - l * s;
-        float p = 2 * l - q;
-        r = hueToRGB(p, q, h + (float) 1 / 3);
-        g = hueToRGB(p, q, h);
-        b = hueToRGB(p, q, h - (float) 1 / 3);
+        if (step) {
+            if (leds.phase[i] == 0xFF)
+                leds.effect[i] = leds.effect[i] == id_effect_breathing_up ? id_effect_breathing_down : id_effect_breathing_up;
+
+            leds.phase[i] += 1;
+        }
     }
+}
 
-    return
-            ((uint32_t) (r * 255) << 16) |
-            ((uint32_t) (g * 255) << 8) |
-            (uint32_t) (b * 255);
+void effect_color_cycle(const struct effect_run *run, bool step) {
+    for (int i = run->start; i <= run->end; ++i) {
+        uint32_t color = hsl_to_rgb(leds.phase[i], 0xFF, 0x80);
+
+        leds.out_r[i] = (uint8_t) ((color >> 16) & 0xff);
+        leds.out_g[i] = (uint8_t) ((color >> 8) & 0xff);
+        leds.out_b[i] = (uint8_t) (color & 0xff);
+
+        if (step)
+            leds.phase[i] += 1;
+    }
 }
 
 
-uint8_t LED_RGB_BUFFER[LED_COUNT * 3] = {0x00};
-uint8_t LED_RGB_OUTPUT_BUFFER[LED_COUNT * 3] = {0x00};
-uint8_t LED_EFFECT_BUFFER[LED_COUNT * 3] = {0x00};
-uint8_t LED_BRIGHTNESS_BUFFER[LED_COUNT] = {0xFF};
-uint8_t SECTION_BUFFER[SECTION_COUNT * 2] = {0, 9, 10, 14, 15, 24, 25, 29, 30, 35, 36, 41, 30, 41, 0, 29};
+const struct {
+    effect eff;
+} effect_table[] = {
+        {effect_static},
+        {effect_breathing},
+        {effect_breathing},
+        {effect_color_cycle},
+};
+
+#define EFFECT_COUNT (sizeof(effect_table) / sizeof(effect_table[0]))
 
+static struct effect_run *effect_runs = NULL;
+static uint16_t effect_run_count = 0;
+// Set when an effect or speed changes, the runs are rebuilt before the next frame
+static bool effect_runs_dirty = true;
 
-// Effects
+// LEDs whose inputs changed since their run was last evaluated, empty while start > end
+static uint16_t dirty_start = 1;
+static uint16_t dirty_end = 0;
+// Some output changed since the last rendered frame
+static bool frame_dirty = true;
 
-void effect_static(uint led, uint t) {
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 0] = LED_RGB_BUFFER[(led * 3) + 0];
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 1] = LED_RGB_BUFFER[(led * 3) + 1];
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 2] = LED_RGB_BUFFER[(led * 3) + 2];
+static void mark_dirty(uint16_t start_led, uint16_t end_led) {
+    if (dirty_start > dirty_end) {
+        dirty_start = start_led;
+        dirty_end = end_led;
+        return;
+    }
 
-    if (!(t % LED_EFFECT_BUFFER[(led * 3) + 2]))
-        LED_EFFECT_BUFFER[(led * 3) + 1] += 1;
+    if (start_led < dirty_start) dirty_start = start_led;
+    if (end_led > dirty_end) dirty_end = end_led;
 }
 
-void effect_breathing_up(uint led, uint t) {
-    uint r, g, b;
-    uint8_t multiplier = LED_EFFECT_BUFFER[(led * 3) + 1];
+static void build_effect_runs(void) {
+    effect_run_count = 0;
+    for (int i = 0; i < leds.count; ++i) {
+        // unknown effects show the base color instead of jumping through the table
+        uint8_t effect_id = leds.effect[i] < EFFECT_COUNT ? leds.effect[i] : id_effect_static;
+        effect eff = effect_table[effect_id].eff;
+
+        if (effect_run_count > 0) {
+            struct effect_run *last = &effect_runs[effect_run_count - 1];
+            if (effect_table[last->effect].eff == eff && last->speed == leds.speed[i]) {
+                last->end = i;
+                continue;
+            }
+        }
 
-    r = LED_RGB_BUFFER[(led * 3) + 0];
-    g = LED_RGB_BUFFER[(led * 3) + 1];
-    b = LED_RGB_BUFFER[(led * 3) + 2];
+        struct effect_run *run = &effect_runs[effect_run_count++];
+        run->effect = effect_id;
+        run->start = i;
+        run->end = i;
+        run->speed = leds.speed[i];
+    }
+    effect_runs_dirty = false;
+    if (leds.count) mark_dirty(0, leds.count - 1);
+}
 
-    r *= multiplier;
-    g *= multiplier;
-    b *= multiplier;
+static inline uint32_t align_up(uint32_t size) {
+    return (size + 3) & ~3u;
+}
 
-    r /= 0xFF;
-    g /= 0xFF;
-    b /= 0xFF;
+static uint32_t led_frame_words(uint16_t count) {
+#if LED_STRIP_COUNT > 1
+    // a byte per bit time, 24 to a position, packed 4 to a word
+    return ((count + LED_STRIP_COUNT - 1) / LED_STRIP_COUNT) * 6;
+#else
+    return count;
+#endif //LED_STRIP_COUNT > 1
+}
+
+//--------------------------------------------------------------------+
+// HOST STREAMED FRAMES
+//--------------------------------------------------------------------+
+// Packed RGB frames written straight from the CDC FIFO. One is being written by the host, one waits for the
+// next frame boundary and one is on the strip, so neither side ever waits on the other.
+#define LED_STREAM_BUFFER_COUNT 3
 
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 0] = (uint8_t) r;
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 1] = (uint8_t) g;
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 2] = (uint8_t) b;
+static uint8_t *stream_buffers[LED_STREAM_BUFFER_COUNT];
+// Guards the hand over of stream_pending and stream_front between the cores
+static spin_lock_t *stream_lock = NULL;
+// Complete frame waiting for the renderer, -1 when none
+static int8_t stream_pending = -1;
+// Frame the renderer shows while streaming
+static int8_t stream_front = -1;
+// Renderer shows streamed frames instead of effects, any fill goes back to effects
+static bool streaming = false;
 
-    if (!(t % LED_EFFECT_BUFFER[(led * 3) + 2])) {
-        if (LED_EFFECT_BUFFER[(led * 3) + 1] == 0xFF)
-            LED_EFFECT_BUFFER[(led * 3) + 0] += 1;
+// Frame the host is writing, owned by the command side
+static int8_t stream_write = -1;
+static uint32_t stream_offset = 0;
+// Last frame handed to the renderer, compressed frames copy their skipped LEDs from it, -1 when none
+static int8_t stream_previous = -1;
 
-        LED_EFFECT_BUFFER[(led * 3) + 1] += 1;
+// Starts receiving a frame of led count * 3 RGB bytes, a partly received frame is dropped
+void ws2812_stream_begin(void) {
+    // a resize still in the queue would clear the buffers under us, even one back to the same count
+    while (led_layout_applied != led_layout_requested) tight_loop_contents();
+    __dmb();
+
+    uint32_t saved_irq = spin_lock_blocking(stream_lock);
+    for (int8_t i = 0; i < LED_STREAM_BUFFER_COUNT; ++i) {
+        if (i != stream_pending && i != stream_front) {
+            stream_write = i;
+            break;
+        }
     }
+    // a resize drops both, the previous frame then no longer matches the strip
+    if (stream_previous != stream_pending && stream_previous != stream_front) stream_previous = -1;
+    spin_unlock(stream_lock, saved_irq);
+
+    stream_offset = 0;
 }
 
-void effect_breathing_down(uint led, uint t) {
-    uint r, g, b;
-    uint8_t multiplier = 0xFF - LED_EFFECT_BUFFER[(led * 3) + 1];
+static void led_stream_publish(void) {
+    // a pending frame the renderer hasn't picked up yet is replaced, the newest frame wins
+    __dmb();
+    uint32_t saved_irq = spin_lock_blocking(stream_lock);
+    stream_pending = stream_write;
+    spin_unlock(stream_lock, saved_irq);
+    __sev();
 
-    r = LED_RGB_BUFFER[(led * 3) + 0];
-    g = LED_RGB_BUFFER[(led * 3) + 1];
-    b = LED_RGB_BUFFER[(led * 3) + 2];
+    stream_previous = stream_write;
+    stream_write = -1;
+}
 
-    r *= multiplier;
-    g *= multiplier;
-    b *= multiplier;
+// Where the next received bytes go and how many still belong to the frame
+uint8_t *ws2812_stream_window(uint32_t *space) {
+    *space = (uint32_t) led_count * 3 - stream_offset;
+    return &stream_buffers[stream_write][stream_offset];
+}
 
-    r /= 0xFF;
-    g /= 0xFF;
-    b /= 0xFF;
+// Accounts for bytes received into the window, returns 1 once the frame is complete and handed to the renderer
+uint8_t ws2812_stream_advance(uint32_t bytes) {
+    stream_offset += bytes;
+    if (stream_offset < (uint32_t) led_count * 3) return 0;
 
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 0] = (uint8_t) r;
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 1] = (uint8_t) g;
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 2] = (uint8_t) b;
+    led_stream_publish();
+    return 1;
+}
 
-    if (!(t % LED_EFFECT_BUFFER[(led * 3) + 2])) {
-        if (LED_EFFECT_BUFFER[(led * 3) + 1] == 0xFF)
-            LED_EFFECT_BUFFER[(led * 3) + 0] -= 1;
+//--------------------------------------------------------------------+
+// COMPRESSED FRAMES
+//--------------------------------------------------------------------+
+// Decoded into the frame being written against the last one handed to the renderer, see stream_decoder.h
 
-        LED_EFFECT_BUFFER[(led * 3) + 1] += 1;
-    }
+static struct stream_decoder stream_decoder;
+
+void ws2812_stream_compressed_begin(void) {
+    ws2812_stream_begin();
+    const uint8_t *previous = stream_previous >= 0 ? stream_buffers[stream_previous] : NULL;
+    stream_decoder_begin(&stream_decoder, stream_buffers[stream_write], previous, (uint32_t) led_count * 3);
+}
+
+uint8_t *ws2812_stream_compressed_window(uint32_t *space) {
+    return stream_decoder_window(&stream_decoder, space);
 }
 
-void effect_color_cycle(uint led, uint t) {
-    float h = (float) (LED_EFFECT_BUFFER[(led * 3) + 1] % 256) / 255;
-    uint32_t color = hslToRGB(h, 1, 0.5);
-    uint8_t r = ((color >> 16) & 0xff);
-    uint8_t g = ((color >> 8) & 0xff);
-    uint8_t b = ((color) & 0xff);
+void ws2812_stream_compressed_advance(uint32_t bytes) {
+    stream_decoder_advance(&stream_decoder, bytes);
+}
 
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 0] = (uint8_t) r;
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 1] = (uint8_t) g;
-    LED_RGB_OUTPUT_BUFFER[(led * 3) + 2] = (uint8_t) b;
+void ws2812_stream_compressed_end(void) {
+    stream_decoder_end(&stream_decoder);
+    led_stream_publish();
+}
 
-    if (!(t % LED_EFFECT_BUFFER[(led * 3) + 2]))
-        LED_EFFECT_BUFFER[(led * 3) + 1] += 1;
+// Picks up a completed frame at the frame boundary
+static void led_stream_take(void) {
+    uint32_t saved_irq = spin_lock_blocking(stream_lock);
+    if (stream_pending >= 0) {
+        stream_front = stream_pending;
+        stream_pending = -1;
+        streaming = true;
+        frame_dirty = true;
+    }
+    spin_unlock(stream_lock, saved_irq);
 }
 
+//--------------------------------------------------------------------+
+// TIMELINES
+//--------------------------------------------------------------------+
+// Keyframe animations per section, played on the device on top of the effects.
+// Keyframes are only touched under timeline_lock, so the host can edit a timeline while it plays.
 
-typedef void (*effect)(uint led, uint t);
+struct timeline_keyframe {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    // curve used on the way from the previous keyframe to this one
+    uint8_t easing;
+    // time from the start of the timeline this color is reached at, increasing
+    uint16_t time_ms;
+};
 
-const struct {
-    effect eff;
-} effect_table[] = {
-        {effect_static},
-        {effect_breathing_up},
-        {effect_breathing_down},
-        {effect_color_cycle},
+struct timeline {
+    struct timeline_keyframe keyframes[TIMELINE_MAX_KEYFRAMES];
+    uint8_t keyframe_count;
+    // restart after the last keyframe instead of holding its color
+    bool loop;
+    bool playing;
+    // stopped, the effects still have to be repainted over the last color
+    bool repaint;
+    // LEDs of the section when it started playing
+    uint16_t start_led;
+    uint16_t end_led;
+    // 64-bit so a held or looping timeline doesn't jump back when the 32-bit timer wraps
+    uint64_t start_us;
+    // last color written, so a held color isn't written again every frame
+    uint32_t color;
+    bool color_valid;
 };
 
-uint8_t ws2812_fill_leds(uint8_t start_led, uint8_t end_led, uint8_t value, uint8_t *data) {
+static struct timeline timelines[SECTION_MAX_COUNT];
+static spin_lock_t *timeline_lock = NULL;
+
+// Q8 progress through a segment, 0-256, shaped by the easing curve
+static uint32_t timeline_ease(uint8_t easing, uint32_t p) {
+    switch (easing) {
+        case id_easing_in:
+            return (p * p) >> 8;
+
+        case id_easing_out:
+            return 256 - (((256 - p) * (256 - p)) >> 8);
+
+        case id_easing_in_out:
+            return p < 128 ? (p * p) >> 7 : 256 - (((256 - p) * (256 - p)) >> 7);
+
+        case id_easing_step:
+            return p < 256 ? 0 : 256;
+
+        case id_easing_linear:
+        default:
+            return p;
+    }
+}
+
+static inline uint8_t timeline_lerp(uint8_t from, uint8_t to, uint32_t eased) {
+    return (uint8_t) (from + (((int32_t) to - from) * (int32_t) eased) / 256);
+}
+
+// Color of a timeline elapsed_us after its start, 0xRRGGBB
+static uint32_t timeline_color(const struct timeline *timeline, uint64_t elapsed_us) {
+    const struct timeline_keyframe *keyframes = timeline->keyframes;
+    const struct timeline_keyframe *last = &keyframes[timeline->keyframe_count - 1];
+
+    uint64_t elapsed = elapsed_us / 1000;
+    if (timeline->loop && last->time_ms) elapsed %= last->time_ms;
+    // the last color holds from its keyframe on, so the rest fits in 32 bits
+    uint32_t elapsed_ms = elapsed < last->time_ms ? (uint32_t) elapsed : last->time_ms;
+
+    const struct timeline_keyframe *to = &keyframes[0];
+    if (elapsed_ms >= last->time_ms) {
+        to = last;
+    } else if (elapsed_ms > keyframes[0].time_ms) {
+        int i = 1;
+        while (keyframes[i].time_ms <= elapsed_ms) i++;
+
+        const struct timeline_keyframe *from = &keyframes[i - 1];
+        to = &keyframes[i];
+        uint32_t p = ((elapsed_ms - from->time_ms) * 256) / (to->time_ms - from->time_ms);
+        uint32_t eased = timeline_ease(to->easing, p);
+
+        return ((uint32_t) timeline_lerp(from->r, to->r, eased) << 16) |
+               ((uint32_t) timeline_lerp(from->g, to->g, eased) << 8) |
+               timeline_lerp(from->b, to->b, eased);
+    }
+
+    return ((uint32_t) to->r << 16) | ((uint32_t) to->g << 8) | to->b;
+}
+
+// Writes every playing timeline over the effect output, force rewrites even held colors after the effects ran
+static void timeline_update(bool force) {
+    uint64_t now = time_us_64();
+
+    for (int section = 0; section < SECTION_MAX_COUNT; ++section) {
+        struct timeline *timeline = &timelines[section];
+        if (!timeline->playing && !timeline->repaint) continue;
+
+        uint32_t saved_irq = spin_lock_blocking(timeline_lock);
+        if (!timeline->playing) {
+            timeline->repaint = false;
+            uint16_t start_led = timeline->start_led;
+            uint16_t end_led = timeline->end_led;
+            spin_unlock(timeline_lock, saved_irq);
+
+            if (start_led >= leds.count) continue;
+            mark_dirty(start_led, end_led < leds.count ? end_led : leds.count - 1);
+            continue;
+        }
+
+        uint32_t color = timeline_color(timeline, now - timeline->start_us);
+        uint16_t start_led = timeline->start_led;
+        uint16_t end_led = timeline->end_led;
+        bool changed = force || !timeline->color_valid || timeline->color != color;
+        timeline->color = color;
+        timeline->color_valid = true;
+        spin_unlock(timeline_lock, saved_irq);
+
+        if (!changed || start_led >= leds.count) continue;
+        if (end_led >= leds.count) end_led = leds.count - 1;
+
+        for (int i = start_led; i <= end_led; ++i) {
+            leds.out_r[i] = (color >> 16) & 0xFF;
+            leds.out_g[i] = (color >> 8) & 0xFF;
+            leds.out_b[i] = color & 0xFF;
+        }
+        frame_dirty = true;
+    }
+}
+
+uint8_t ws2812_timeline_set_keyframe(uint8_t section_id, uint8_t index, const uint8_t *rgb, uint8_t easing, uint16_t time_ms) {
+    if (section_id >= section_count || index >= TIMELINE_MAX_KEYFRAMES) return 0;
+
+    uint32_t saved_irq = spin_lock_blocking(timeline_lock);
+    struct timeline *timeline = &timelines[section_id];
+    // a keyframe in use has to stay between its neighbours, shorten the timeline first to reorder it
+    if (index < timeline->keyframe_count) {
+        bool after_previous = !index || time_ms > timeline->keyframes[index - 1].time_ms;
+        bool before_next = index + 1 >= timeline->keyframe_count || time_ms < timeline->keyframes[index + 1].time_ms;
+        if (!after_previous || !before_next) {
+            spin_unlock(timeline_lock, saved_irq);
+            return 0;
+        }
+    }
+
+    struct timeline_keyframe *keyframe = &timeline->keyframes[index];
+    keyframe->r = rgb[0];
+    keyframe->g = rgb[1];
+    keyframe->b = rgb[2];
+    keyframe->easing = easing;
+    keyframe->time_ms = time_ms;
+    spin_unlock(timeline_lock, saved_irq);
+    return 1;
+}
+
+// Takes the first count keyframes as the timeline, their times have to increase
+uint8_t ws2812_timeline_set_length(uint8_t section_id, uint8_t count, bool loop) {
+    if (section_id >= section_count || !count || count > TIMELINE_MAX_KEYFRAMES) return 0;
+
+    uint32_t saved_irq = spin_lock_blocking(timeline_lock);
+    struct timeline *timeline = &timelines[section_id];
+    for (int i = 1; i < count; ++i) {
+        if (timeline->keyframes[i].time_ms <= timeline->keyframes[i - 1].time_ms) {
+            spin_unlock(timeline_lock, saved_irq);
+            return 0;
+        }
+    }
+
+    timeline->keyframe_count = count;
+    timeline->loop = loop;
+    spin_unlock(timeline_lock, saved_irq);
+    return 1;
+}
+
+uint8_t ws2812_timeline_play(uint8_t section_id) {
+    if (section_id >= section_count) return 0;
+
+    uint32_t saved_irq = spin_lock_blocking(timeline_lock);
+    struct timeline *timeline = &timelines[section_id];
+    if (!timeline->keyframe_count) {
+        spin_unlock(timeline_lock, saved_irq);
+        return 0;
+    }
+
+    timeline->start_led = sections[section_id].start_led;
+    timeline->end_led = sections[section_id].end_led;
+    timeline->start_us = time_us_64();
+    timeline->color_valid = false;
+    timeline->repaint = false;
+    timeline->playing = true;
+    spin_unlock(timeline_lock, saved_irq);
+    return 1;
+}
+
+static void timeline_stop_locked(struct timeline *timeline) {
+    if (timeline->playing) {
+        timeline->playing = false;
+        // the renderer repaints the effects under it on its next pass
+        timeline->repaint = true;
+    }
+}
+
+uint8_t ws2812_timeline_stop(uint8_t section_id) {
+    if (section_id >= section_count) return 0;
+
+    uint32_t saved_irq = spin_lock_blocking(timeline_lock);
+    timeline_stop_locked(&timelines[section_id]);
+    spin_unlock(timeline_lock, saved_irq);
+    return 1;
+}
+
+// Arena bytes needed for count LEDs
+static uint32_t led_layout_size(uint16_t count) {
+    return 10 * align_up(count) + align_up(count * sizeof(struct effect_run)) + 2 * led_frame_words(count) * sizeof(uint32_t) +
+           LED_STREAM_BUFFER_COUNT * align_up(count * 3);
+}
+
+static uint8_t *arena_take(uint32_t *used, uint32_t size) {
+    uint8_t *block = (uint8_t *) led_arena + *used;
+    *used += align_up(size);
+    return block;
+}
+
+// Carves the arena for count LEDs and resets them to black static LEDs at full brightness
+static void led_layout_apply(uint16_t count) {
+    // the DMA may still be reading the front frame out of the arena
+    while (led_frame_busy()) tight_loop_contents();
+
+    uint32_t used = 0;
+    leds.base_r = arena_take(&used, count);
+    leds.base_g = arena_take(&used, count);
+    leds.base_b = arena_take(&used, count);
+    leds.out_r = arena_take(&used, count);
+    leds.out_g = arena_take(&used, count);
+    leds.out_b = arena_take(&used, count);
+    leds.effect = arena_take(&used, count);
+    leds.phase = arena_take(&used, count);
+    leds.speed = arena_take(&used, count);
+    leds.brightness = arena_take(&used, count);
+    effect_runs = (struct effect_run *) arena_take(&used, count * sizeof(struct effect_run));
+
+    frame_words = led_frame_words(count);
+    LED_FRAME_BUFFER[0] = (uint32_t *) arena_take(&used, frame_words * sizeof(uint32_t));
+    LED_FRAME_BUFFER[1] = (uint32_t *) arena_take(&used, frame_words * sizeof(uint32_t));
+    for (int i = 0; i < LED_STREAM_BUFFER_COUNT; ++i) {
+        stream_buffers[i] = arena_take(&used, count * 3);
+    }
+    strip_length = (count + LED_STRIP_COUNT - 1) / LED_STRIP_COUNT;
+
+    for (uint32_t i = 0; i < used / sizeof(uint32_t); ++i) led_arena[i] = 0;
+    for (int i = 0; i < count; ++i) leds.brightness[i] = 0xFF;
+    brightness_luts_dirty = true;
+
+    leds.count = count;
+    effect_run_count = 0;
+    effect_runs_dirty = true;
+    back_frame_ready = false;
+    frame_dirty = true;
+
+    uint32_t saved_irq = spin_lock_blocking(stream_lock);
+    stream_pending = -1;
+    stream_front = -1;
+    streaming = false;
+    spin_unlock(stream_lock, saved_irq);
+}
+
+// Command value that resizes the strip to start_led LEDs, outside the protocol's lighting values
+#define LED_COMMAND_SET_COUNT 0xFF
+
+static void led_apply(uint16_t start_led, uint16_t end_led, uint8_t value, const uint8_t *data) {
+    if (value == LED_COMMAND_SET_COUNT) {
+        led_layout_apply(start_led);
+        __dmb();
+        led_layout_applied++;
+        return;
+    }
+
+    if (streaming) {
+        // back to the effects, their output is still what it was before the stream
+        streaming = false;
+        frame_dirty = true;
+    }
+
     for (int i = start_led; i <= end_led; ++i) {
         switch (value) {
             case id_led_base_color: {
-                LED_RGB_BUFFER[(i * 3) + 0] = data[0];
-                LED_RGB_BUFFER[(i * 3) + 1] = data[1];
-                LED_RGB_BUFFER[(i * 3) + 2] = data[2];
+                leds.base_r[i] = data[0];
+                leds.base_g[i] = data[1];
+                leds.base_b[i] = data[2];
                 break;
             }
 
             case id_led_effect: {
-                LED_EFFECT_BUFFER[(i * 3) + 0] = data[0];
-                LED_EFFECT_BUFFER[(i * 3) + 1] = 0x00;
+                leds.effect[i] = data[0];
+                leds.phase[i] = 0x00;
                 break;
             }
 
             case id_led_effect_spaced: {
-                LED_EFFECT_BUFFER[(i * 3) + 0] = data[0];
+                leds.effect[i] = data[0];
                 uint offset = ((i - start_led) * 0xFF);
                 offset /= (end_led - start_led) + 1;
-                LED_EFFECT_BUFFER[(i * 3) + 1] = (uint8_t) offset;
+                leds.phase[i] = (uint8_t) offset;
                 break;
             }
 
             case id_led_offset: {
-                LED_EFFECT_BUFFER[(i * 3) + 1] = data[0];
+                leds.phase[i] = data[0];
                 break;
             }
 
             case id_led_speed: {
-                LED_EFFECT_BUFFER[(i * 3) + 2] = data[0];
+                leds.speed[i] = data[0];
                 break;
             }
 
             case id_led_brightness: {
-                LED_BRIGHTNESS_BUFFER[i] = data[0];
+                leds.brightness[i] = data[0];
                 break;
             }
 
             default: {
-                return 0;
+                return;
             }
         }
     }
+
+    if (value == id_led_effect || value == id_led_effect_spaced || value == id_led_speed)
+        effect_runs_dirty = true;
+    else if (value == id_led_brightness)
+        frame_dirty = brightness_luts_dirty = true;
+    else
+        mark_dirty(start_led, end_led);
+}
+
+#if LED_USE_CORE1
+//--------------------------------------------------------------------+
+// LED COMMAND QUEUE
+//--------------------------------------------------------------------+
+// Single producer (core0, the CDC handler) / single consumer (the LED pipeline) ring.
+// Each side only writes its own index, so no lock is needed between the cores.
+
+struct led_command {
+    uint16_t start_led;
+    uint16_t end_led;
+    uint8_t value;
+    uint8_t data[3];
+};
+
+static struct led_command led_command_queue[LED_COMMAND_QUEUE_LENGTH];
+static volatile uint32_t led_command_head = 0;
+static volatile uint32_t led_command_tail = 0;
+// Next slot the producer writes, ahead of the head while a batch is open
+static uint32_t led_command_write = 0;
+static bool led_batch_open = false;
+
+static void led_command_publish(void) {
+    // publish the slots only after their contents are written
+    __dmb();
+    led_command_head = led_command_write;
+    __sev();
+}
+
+static void led_command_push(uint16_t start_led, uint16_t end_led, uint8_t value, const uint8_t *data) {
+    uint32_t head = led_command_write;
+    while (head - led_command_tail >= LED_COMMAND_QUEUE_LENGTH) {
+        tight_loop_contents(); // consumer is a frame behind, it drains the whole queue every pass
+    }
+
+    struct led_command *command = &led_command_queue[head % LED_COMMAND_QUEUE_LENGTH];
+    command->start_led = start_led;
+    command->end_led = end_led;
+    command->value = value;
+    command->data[0] = data[0];
+    command->data[1] = data[1];
+    command->data[2] = data[2];
+
+    led_command_write = head + 1;
+    if (!led_batch_open) led_command_publish();
+}
+
+static void led_command_drain(void) {
+    uint32_t tail = led_command_tail;
+    uint32_t head = led_command_head;
+    __dmb();
+
+    while (tail != head) {
+        struct led_command *command = &led_command_queue[tail % LED_COMMAND_QUEUE_LENGTH];
+        led_apply(command->start_led, command->end_led, command->value, command->data);
+        tail++;
+    }
+
+    __dmb();
+    led_command_tail = tail;
+}
+#endif //LED_USE_CORE1
+
+// Fills in a batch reach the renderer together, none of them can show up a frame before the others
+uint8_t ws2812_batch_begin(uint16_t fill_count) {
+#if LED_USE_CORE1
+    // the whole batch has to fit, the consumer can't free slots it hasn't been shown yet
+    if (fill_count > LED_COMMAND_QUEUE_LENGTH) return 0;
+    while (led_command_write + fill_count - led_command_tail > LED_COMMAND_QUEUE_LENGTH) {
+        tight_loop_contents();
+    }
+
+    led_batch_open = true;
+#else
+    // applied right away on the renderer's core, no frame can start until the handler returns
+    (void) fill_count;
+#endif //LED_USE_CORE1
+    return 1;
+}
+
+void ws2812_batch_end(void) {
+#if LED_USE_CORE1
+    led_batch_open = false;
+    led_command_publish();
+#endif //LED_USE_CORE1
+}
+
+uint8_t ws2812_check_fill(uint16_t start_led, uint16_t end_led, uint8_t value) {
+    if (start_led > end_led || end_led >= led_count) return 0;
+
+    switch (value) {
+        case id_led_base_color:
+        case id_led_effect:
+        case id_led_effect_spaced:
+        case id_led_offset:
+        case id_led_speed:
+        case id_led_brightness:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+uint8_t ws2812_fill_leds(uint16_t start_led, uint16_t end_led, uint8_t value, uint8_t *data) {
+    if (!ws2812_check_fill(start_led, end_led, value)) return 0;
+
+#if LED_USE_CORE1
+    led_command_push(start_led, end_led, value, data);
+#else
+    // same core as the renderer, which can't drain the queue while we wait on it
+    led_apply(start_led, end_led, value, data);
+#endif //LED_USE_CORE1
     return 1;
 }
 
 uint8_t ws2812_fill_section(uint8_t section_id, uint8_t value, uint8_t *data) {
-    return ws2812_fill_leds(SECTION_BUFFER[(section_id * 2) + 0], SECTION_BUFFER[(section_id * 2) + 1], value, data);
+    if (section_id >= section_count) return 0;
+    return ws2812_fill_leds(sections[section_id].start_led, sections[section_id].end_led, value, data);
+}
+
+uint8_t ws2812_set_led_count(uint16_t count) {
+    if (!count || led_layout_size(count) > LED_ARENA_SIZE) return 0;
+    // a resize clears every LED, don't do it for nothing
+    if (count == led_count) return 1;
+
+    led_count = count;
+#if LED_USE_CORE1
+    led_layout_requested++;
+    uint8_t data[3] = {0};
+    led_command_push(count, count, LED_COMMAND_SET_COUNT, data);
+#else
+    led_layout_apply(count);
+#endif //LED_USE_CORE1
+    return 1;
+}
+
+uint16_t ws2812_get_led_count(void) {
+    return led_count;
+}
+
+// Sections are only used to resolve fills on the command side, so they are changed in place
+uint8_t ws2812_set_section(uint8_t section_id, uint16_t start_led, uint16_t end_led) {
+    if (section_id >= SECTION_MAX_COUNT || start_led > end_led) return 0;
+
+    sections[section_id].start_led = start_led;
+    sections[section_id].end_led = end_led;
+    return 1;
+}
+
+uint8_t ws2812_get_section(uint8_t section_id, uint16_t *start_led, uint16_t *end_led) {
+    if (section_id >= section_count) return 0;
+
+    *start_led = sections[section_id].start_led;
+    *end_led = sections[section_id].end_led;
+    return 1;
+}
+
+uint8_t ws2812_set_section_count(uint8_t count) {
+    if (count > SECTION_MAX_COUNT) return 0;
+
+    // the timelines are bounded by section_count too, ones past it couldn't be stopped anymore
+    uint32_t saved_irq = spin_lock_blocking(timeline_lock);
+    for (int i = count; i < section_count; ++i) timeline_stop_locked(&timelines[i]);
+    spin_unlock(timeline_lock, saved_irq);
+
+    section_count = count;
+    return 1;
+}
+
+uint8_t ws2812_get_section_count(void) {
+    return section_count;
+}
+
+void ws2812_get_frame_timing(uint32_t *effect_us, uint32_t *render_us, uint32_t *transmit_us) {
+    *effect_us = effect_time_us;
+    *render_us = render_time_us;
+    // 24 bits at 800kHz per LED on the longest strip, then the latch
+    *transmit_us = ((uint32_t) led_frame_words(led_count) * (LED_STRIP_COUNT > 1 ? 4 : 24) * 5) / 4 + WS2812_RESET_US;
 }
 
 //--------------------------------------------------------------------+
 // WS2812 UPDATE TASK
 //--------------------------------------------------------------------+
+static void ws2812_irq_init(void);
+#if LED_USE_CORE1
+static void led_core1_entry(void);
+#endif //LED_USE_CORE1
+
 void ws2812_init(void)
 {
     //set_sys_clock_48();
     stdio_init_all();
     puts("WS2812 Smoke Test");
 
-    // todo get free sm
-    PIO pio = pio1;
-    int sm = 0;
-    uint offset = pio_add_program(pio, &ws2812_program);
+    led_sm = pio_claim_unused_sm(led_pio, true);
+#if LED_STRIP_COUNT > 1
+    uint offset = pio_add_program(led_pio, &ws2812_parallel_program);
 
-    ws2812_program_init(pio, sm, offset, PIN_TX, 800000, false);
+    ws2812_parallel_program_init(led_pio, led_sm, offset, LED_STRIP_PIN_BASE, LED_STRIP_COUNT, 800000);
+#else
+    uint offset = pio_add_program(led_pio, &ws2812_program);
 
-    for (int i = 0; i < LED_COUNT; ++i) {
-        LED_RGB_BUFFER[(i * 3) + 0] = 0x00;
-        LED_RGB_BUFFER[(i * 3) + 1] = 0x00;
-        LED_RGB_BUFFER[(i * 3) + 2] = 0x00;
+    ws2812_program_init(led_pio, led_sm, offset, PIN_TX, 800000, false);
+#endif //LED_STRIP_COUNT > 1
 
-        LED_RGB_OUTPUT_BUFFER[(i * 3) + 0] = 0x00;
-        LED_RGB_OUTPUT_BUFFER[(i * 3) + 1] = 0x00;
-        LED_RGB_OUTPUT_BUFFER[(i * 3) + 2] = 0x00;
+    led_dma_channel = dma_claim_unused_channel(true);
+    dma_channel_config c = dma_channel_get_default_config(led_dma_channel);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(led_pio, led_sm, true));
+    dma_channel_configure(led_dma_channel, &c, &led_pio->txf[led_sm], NULL, 0, false);
 
-        LED_EFFECT_BUFFER[(i * 3) + 0] = 0x00;
-        LED_EFFECT_BUFFER[(i * 3) + 1] = 0x00;
-        LED_EFFECT_BUFFER[(i * 3) + 2] = 0x00;
+    stream_lock = spin_lock_init(spin_lock_claim_unused(true));
+    timeline_lock = spin_lock_init(spin_lock_claim_unused(true));
 
-        LED_BRIGHTNESS_BUFFER[i] = 0xFF;
-    }
+    led_count = LED_DEFAULT_COUNT;
+    led_layout_apply(LED_DEFAULT_COUNT);
+
+#if LED_USE_CORE1
+    multicore_launch_core1(led_core1_entry);
+#else
+    ws2812_irq_init();
+#endif //LED_USE_CORE1
 }
 
 void led_effect_update_task(unsigned int t)
 {
-    for (int i = 0; i < LED_COUNT; ++i) {
-        effect_table[LED_EFFECT_BUFFER[(i * 3) + 0]].eff(i, t);
+#if LED_USE_CORE1
+    led_command_drain();
+#endif //LED_USE_CORE1
+
+    // a streamed frame is on the strip, the effects pick up where they were when a fill ends the stream
+    if (streaming) return;
+
+    uint32_t start = time_us_32();
+
+    if (effect_runs_dirty) build_effect_runs();
+
+    bool effects_ran = false;
+    for (int i = 0; i < effect_run_count; ++i) {
+        const struct effect_run *run = &effect_runs[i];
+        // speed 0 holds the phase still
+        effect eff = effect_table[run->effect].eff;
+        bool step = run->speed && !(t % run->speed) && eff != effect_static;
+        bool touched = dirty_start <= dirty_end && run->start <= dirty_end && run->end >= dirty_start;
+        // the output only depends on the inputs and the phase, skip runs where neither moved
+        if (!step && !touched) continue;
+
+        eff(run, step);
+        effects_ran = true;
     }
+    if (effects_ran) frame_dirty = true;
+
+    // cleared before the timelines, a stopped one marks its LEDs for the effects to repaint next pass
+    dirty_start = 1;
+    dirty_end = 0;
+
+    timeline_update(effects_ran);
+
+    effect_time_us = time_us_32() - start;
+}
+
+bool ws2812_frame_in_flight(void)
+{
+    return led_frame_busy();
+}
+
+void ws2812_set_global_brightness(uint8_t brightness)
+{
+    global_brightness = brightness;
 }
 
+static inline uint8_t brightness_scale(uint8_t value, uint32_t scale)
+{
+    return led_gamma[(value * scale) / (0xFF * 0xFF)];
+}
+
+// Gives every LED brightness in use a table while there are tables left, only run when a brightness changes
+static void brightness_lut_refresh(void)
+{
+    // the global brightness is folded into every table, a new one invalidates them all
+    uint8_t global = global_brightness;
+    if (global != brightness_lut_global) {
+        for (int i = 0; i < BRIGHTNESS_LUT_COUNT; ++i) brightness_luts[i].used = false;
+        brightness_lut_global = global;
+    }
+
+    bool in_use[256] = {false};
+    for (int i = 0; i < leds.count; ++i) in_use[leds.brightness[i]] = true;
+
+    // tables for values still in use are kept as they are
+    for (int i = 0; i < 256; ++i) brightness_lut_for[i] = NULL;
+    for (int i = 0; i < BRIGHTNESS_LUT_COUNT; ++i) {
+        struct brightness_lut *table = &brightness_luts[i];
+        if (!table->used) continue;
+
+        if (in_use[table->brightness]) {
+            brightness_lut_for[table->brightness] = table->lut;
+        } else {
+            table->used = false;
+        }
+    }
+
+    int next = 0;
+    for (int brightness = 0; brightness < 256; ++brightness) {
+        if (!in_use[brightness] || brightness_lut_for[brightness]) continue;
+
+        while (next < BRIGHTNESS_LUT_COUNT && brightness_luts[next].used) next++;
+        // out of tables, the rest are scaled per LED
+        if (next == BRIGHTNESS_LUT_COUNT) break;
+
+        struct brightness_lut *table = &brightness_luts[next];
+        uint32_t scale = (uint32_t) brightness * global;
+        for (int v = 0; v < 256; ++v) {
+            table->lut[v] = brightness_scale(v, scale);
+        }
+        table->brightness = brightness;
+        table->used = true;
+        brightness_lut_for[brightness] = table->lut;
+    }
+
+    brightness_luts_dirty = false;
+}
+
+#if LED_STRIP_COUNT > 1
+// Byte s of in is strip s, byte k of out is bit 7 - k of every strip with strip s on bit s
+static inline void transpose_8x8(const uint8_t *in, uint8_t *out)
+{
+    uint32_t x = ((uint32_t) in[7] << 24) | ((uint32_t) in[6] << 16) | ((uint32_t) in[5] << 8) | in[4];
+    uint32_t y = ((uint32_t) in[3] << 24) | ((uint32_t) in[2] << 16) | ((uint32_t) in[1] << 8) | in[0];
+    uint32_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA;
+    x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;
+    y = y ^ t ^ (t << 7);
+
+    t = (x ^ (x >> 14)) & 0x0000CCCC;
+    x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC;
+    y = y ^ t ^ (t << 14);
+
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = t;
+
+    out[0] = x >> 24;
+    out[1] = (x >> 16) & 0xFF;
+    out[2] = (x >> 8) & 0xFF;
+    out[3] = x & 0xFF;
+    out[4] = y >> 24;
+    out[5] = (y >> 16) & 0xFF;
+    out[6] = (y >> 8) & 0xFF;
+    out[7] = y & 0xFF;
+}
+
+// Bit planes for every strip at once, G then R then B, MSB first like the single strip program
+// LED i takes its color from r, g and b at i * stride
+static void ws2812_render_frame(uint32_t *frame, const uint8_t *r_in, const uint8_t *g_in, const uint8_t *b_in, uint stride)
+{
+    uint8_t g[8] = {0}, r[8] = {0}, b[8] = {0};
+
+    for (int position = 0; position < strip_length; ++position) {
+        for (int strip = 0; strip < LED_STRIP_COUNT; ++strip) {
+            int i = strip * strip_length + position;
+            if (i >= leds.count) {
+                // the last strip can be shorter, its tail stays dark
+                g[strip] = r[strip] = b[strip] = 0;
+                continue;
+            }
+
+            const uint8_t *lut = brightness_lut_for[leds.brightness[i]];
+            if (lut) {
+                g[strip] = lut[g_in[i * stride]];
+                r[strip] = lut[r_in[i * stride]];
+                b[strip] = lut[b_in[i * stride]];
+            } else {
+                uint32_t scale = (uint32_t) leds.brightness[i] * brightness_lut_global;
+                g[strip] = brightness_scale(g_in[i * stride], scale);
+                r[strip] = brightness_scale(r_in[i * stride], scale);
+                b[strip] = brightness_scale(b_in[i * stride], scale);
+            }
+        }
+
+        // the state machine shifts each word out low byte first, which is the first byte in memory
+        uint8_t *bit_times = (uint8_t *) &frame[position * 6];
+        transpose_8x8(g, &bit_times[0]);
+        transpose_8x8(r, &bit_times[8]);
+        transpose_8x8(b, &bit_times[16]);
+    }
+}
+#else
+// LED i takes its color from r, g and b at i * stride
+static void ws2812_render_frame(uint32_t *frame, const uint8_t *r, const uint8_t *g, const uint8_t *b, uint stride)
+{
+    for (int i = 0; i < leds.count; ++i) {
+        const uint8_t *lut = brightness_lut_for[leds.brightness[i]];
+        if (lut) {
+            frame[i] = urgb_u32(lut[r[i * stride]], lut[g[i * stride]], lut[b[i * stride]]) << 8u;
+        } else {
+            uint32_t scale = (uint32_t) leds.brightness[i] * brightness_lut_global;
+            frame[i] = urgb_u32(brightness_scale(r[i * stride], scale), brightness_scale(g[i * stride], scale),
+                                brightness_scale(b[i * stride], scale)) << 8u;
+        }
+    }
+}
+#endif //LED_STRIP_COUNT > 1
+
 void ws2812_update_task(void)
 {
-    for (int i = 0; i < LED_COUNT; ++i) {
-        unsigned int r = LED_RGB_OUTPUT_BUFFER[(i * 3) + 0];
-        unsigned int g = LED_RGB_OUTPUT_BUFFER[(i * 3) + 1];
-        unsigned int b = LED_RGB_OUTPUT_BUFFER[(i * 3) + 2];
+    if (global_brightness != brightness_lut_global) frame_dirty = brightness_luts_dirty = true;
+    led_stream_take();
 
-        r *= LED_BRIGHTNESS_BUFFER[i];
-        g *= LED_BRIGHTNESS_BUFFER[i];
-        b *= LED_BRIGHTNESS_BUFFER[i];
+    // the front frame belongs to the DMA until the reset alarm fires, render into the back one meanwhile
+    if (frame_dirty) {
+        if (brightness_luts_dirty) brightness_lut_refresh();
+        uint32_t start = time_us_32();
+        if (streaming) {
+            const uint8_t *rgb = stream_buffers[stream_front];
+            ws2812_render_frame(LED_FRAME_BUFFER[front_frame ^ 1], &rgb[0], &rgb[1], &rgb[2], 3);
+        } else {
+            ws2812_render_frame(LED_FRAME_BUFFER[front_frame ^ 1], leds.out_r, leds.out_g, leds.out_b, 1);
+        }
+        render_time_us = time_us_32() - start;
+        frame_dirty = false;
+        back_frame_ready = true;
+    }
 
-        r /= 0xFF;
-        g /= 0xFF;
-        b /= 0xFF;
+    if (led_frame_busy()) return;
+
+    uint32_t now = time_us_32();
+    if (back_frame_ready) {
+        front_frame ^= 1;
+        back_frame_ready = false;
+    } else if (now - last_frame_us < LED_REFRESH_PERIOD_US) {
+        // nothing changed, the strip already shows the front frame
+        return;
+    }
+
+    // an unchanged front frame is still resent now and then, in case a glitch on the line corrupted it
+    last_frame_us = now;
+    frame_in_flight = true;
+    dma_channel_set_trans_count(led_dma_channel, frame_words, false);
+    dma_channel_set_read_addr(led_dma_channel, LED_FRAME_BUFFER[front_frame], true);
+}
+
+//--------------------------------------------------------------------+
+// CORE1 LED PIPELINE
+//--------------------------------------------------------------------+
+static void ws2812_irq_init(void)
+{
+    // the handler runs on whichever core calls this
+    irq_add_shared_handler(DMA_IRQ_0, ws2812_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    dma_channel_set_irq0_enabled(led_dma_channel, true);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+#if LED_USE_CORE1
+static void led_core1_entry(void)
+{
+    ws2812_irq_init();
+
+    unsigned int t = 0;
+    uint64_t next_frame_us = time_us_64();
+    while (1) {
+        uint64_t now = time_us_64();
+        if (now >= next_frame_us) {
+            led_effect_update_task(t++);
+            ws2812_update_task();
+
+            next_frame_us += LED_FRAME_PERIOD_US;
+            if (next_frame_us <= now) next_frame_us = now + LED_FRAME_PERIOD_US;
+        }
 
-        put_pixel(urgb_u32(r, g, b));
+        // woken early by the producer's SEV so commands are applied before the next frame
+        if (best_effort_wfe_or_timeout(from_us_since_boot(next_frame_us))) continue;
+        led_command_drain();
     }
 }
+#endif //LED_USE_CORE1
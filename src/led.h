@@ -2,23 +2,133 @@
 #define LED_MANAGER
 
 #include <stdio.h>
+#include <string.h>
 #include <pico/stdio.h>
+#include "pico/multicore.h"
+#include "hardware/sync.h"
 #include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "pico/time.h"
 #include "data_protocol.h"
+#include "config.h"
+#include "color.h"
+#include "stream_decoder.h"
 #include "generated/ws2812.pio.h"
 
-#define LED_COUNT 42
-#define SECTION_COUNT 8
+// LEDs and sections at boot, the host can change both at runtime
+#define LED_DEFAULT_COUNT 42
+#define SECTION_DEFAULT_COUNT 8
+#define SECTION_MAX_COUNT 32
+// Bytes reserved for every per LED buffer, this bounds the runtime LED count.
+// An LED takes 33 bytes on a single strip and 25 + 48 / LED_STRIP_COUNT in parallel,
+// so this fits about 3970 LEDs on one strip and 4220 over 8 strips.
+#define LED_ARENA_SIZE (128 * 1024)
 #define PIN_TX 0
 
+// Strips driven at once from one state machine on consecutive pins from LED_STRIP_PIN_BASE, 1 uses the single strip program on PIN_TX
+#ifndef LED_STRIP_COUNT
+#define LED_STRIP_COUNT 1
+#endif //LED_STRIP_COUNT
+
+#if LED_STRIP_COUNT > 8
+#error "LED_STRIP_COUNT must be 8 or less"
+#endif //LED_STRIP_COUNT > 8
+
+// First strip's pin in parallel mode, past the input pins so all 8 strips fit
+#ifndef LED_STRIP_PIN_BASE
+#define LED_STRIP_PIN_BASE 13
+#endif //LED_STRIP_PIN_BASE
+
+#if LED_STRIP_COUNT > 1
+#define LED_PIN_FIRST LED_STRIP_PIN_BASE
+#else
+#define LED_PIN_FIRST PIN_TX
+#endif //LED_STRIP_COUNT > 1
+#define LED_PIN_LAST (LED_PIN_FIRST + LED_STRIP_COUNT - 1)
+
+#if LED_PIN_FIRST <= INPUT_PIN_LAST && LED_PIN_LAST >= INPUT_PIN_FIRST
+#error "The LED data pins overlap the button and hat pins"
+#endif //LED_PIN_FIRST <= INPUT_PIN_LAST && LED_PIN_LAST >= INPUT_PIN_FIRST
+
+#if LED_PIN_LAST > 29
+#error "The LED data pins run past GPIO 29"
+#endif //LED_PIN_LAST > 29
+// Time after the last DMA word before the next frame may start, covers the FIFO drain and the >50us latch
+#define WS2812_RESET_US 400
+// Commands waiting for the LED pipeline, must be a power of 2
+#define LED_COMMAND_QUEUE_LENGTH 64
+
+#ifndef LED_USE_CORE1
+#define LED_USE_CORE1 false
+#endif //LED_USE_CORE1
+
+// Keyframes each section's timeline can hold
+#define TIMELINE_MAX_KEYFRAMES 8
+
+// Gamma/brightness tables, one per distinct LED brightness in use, LEDs past that many values are scaled directly
+#define BRIGHTNESS_LUT_COUNT 16
+
+// Unchanged frames are resent at this period to recover from line glitches
+#define LED_REFRESH_PERIOD_US 1000000
+
+// Frame period of the core1 pipeline, the core0 scheduler uses its own task periods
+#define LED_FRAME_PERIOD_US 10000
+
 void ws2812_init(void);
 
 void led_effect_update_task(unsigned int i);
 
 void ws2812_update_task(void);
 
-uint8_t ws2812_fill_leds(uint8_t start_led, uint8_t end_led, uint8_t value, uint8_t *data);
+bool ws2812_frame_in_flight(void);
+
+void ws2812_set_global_brightness(uint8_t brightness);
+
+uint8_t ws2812_check_fill(uint16_t start_led, uint16_t end_led, uint8_t value);
+
+uint8_t ws2812_fill_leds(uint16_t start_led, uint16_t end_led, uint8_t value, uint8_t *data);
+
+uint8_t ws2812_batch_begin(uint16_t fill_count);
+
+void ws2812_batch_end(void);
 
 uint8_t ws2812_fill_section(uint8_t section_id, uint8_t value, uint8_t *data);
 
+uint8_t ws2812_set_led_count(uint16_t count);
+
+uint16_t ws2812_get_led_count(void);
+
+uint8_t ws2812_set_section(uint8_t section_id, uint16_t start_led, uint16_t end_led);
+
+uint8_t ws2812_get_section(uint8_t section_id, uint16_t *start_led, uint16_t *end_led);
+
+uint8_t ws2812_set_section_count(uint8_t count);
+
+uint8_t ws2812_get_section_count(void);
+
+void ws2812_get_frame_timing(uint32_t *effect_us, uint32_t *render_us, uint32_t *transmit_us);
+
+uint8_t ws2812_timeline_set_keyframe(uint8_t section_id, uint8_t index, const uint8_t *rgb, uint8_t easing, uint16_t time_ms);
+
+uint8_t ws2812_timeline_set_length(uint8_t section_id, uint8_t count, bool loop);
+
+uint8_t ws2812_timeline_play(uint8_t section_id);
+
+uint8_t ws2812_timeline_stop(uint8_t section_id);
+
+void ws2812_stream_begin(void);
+
+uint8_t *ws2812_stream_window(uint32_t *space);
+
+uint8_t ws2812_stream_advance(uint32_t bytes);
+
+void ws2812_stream_compressed_begin(void);
+
+uint8_t *ws2812_stream_compressed_window(uint32_t *space);
+
+void ws2812_stream_compressed_advance(uint32_t bytes);
+
+void ws2812_stream_compressed_end(void);
+
 #endif //LED_MANAGER
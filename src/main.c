@@ -41,6 +41,9 @@
 #include "config.h"
 #include "encoder.h"
 #include "input.h"
+#include "scheduler.h"
+#include "framing.h"
+#include "cdc_tx.h"
 
 //--------------------------------------------------------------------+
 // MACRO CONSTANT TYPEDEF PROTYPES
@@ -59,39 +62,68 @@ enum {
 
 static uint32_t blink_interval_ms = BLINK_NOT_MOUNTED;
 
+// Task periods, in us of the hardware timer
+#define INPUT_TASK_PERIOD_US 500
+#define ENCODER_TASK_PERIOD_US 1000
+#if HID_LOW_LATENCY
+// only samples the inputs, a report goes out only when they changed
+#define HID_TASK_PERIOD_US 500
+#else
+#define HID_TASK_PERIOD_US 10000
+#endif //HID_LOW_LATENCY
+#define BLINK_TASK_PERIOD_US 10000
+#define LED_EFFECT_TASK_PERIOD_US 10000
+#define LED_OUTPUT_TASK_PERIOD_US 10000
+// checks the state subscription deadline, bounds its rate
+#define STATE_STREAM_TASK_PERIOD_US 500
+#define STATE_STREAM_MAX_RATE_HZ 1000
+// TX queue room kept for the reply to the command being parsed, no reply is longer than the frame buffer plus its length
+#define CDC_REPLY_RESERVE (FRAME_BUFFER_SIZE + 2)
+
 void led_blinking_task(void);
 
+void cdc_init(void);
+
 void cdc_task(void);
 
 void hid_task(void);
 
+void led_effect_task(void);
+
+void state_stream_task(void);
+
 /*------------- MAIN -------------*/
 int main(void) {
     board_init();
     tusb_init();
     ws2812_init();
     input_init();
-
-    unsigned short l = 0;
-    unsigned int t = 0;
-    while (1) {
-        tud_task(); // tinyusb device task
-        led_blinking_task();
-
-        cdc_task();
-        hid_task();
-
-        if (++l == 512) {
-            led_effect_update_task(t);
-            ws2812_update_task();
-            l = 0;
-            t++;
-        }
-    }
+    cdc_init();
+
+    scheduler_add_task(tud_task, 0); // tinyusb device task
+    scheduler_add_task(cdc_task, 0);
+    scheduler_add_task(input_task, INPUT_TASK_PERIOD_US);
+    scheduler_add_task(encoder_task, ENCODER_TASK_PERIOD_US);
+    scheduler_add_task(hid_task, HID_TASK_PERIOD_US);
+    scheduler_add_task(led_blinking_task, BLINK_TASK_PERIOD_US);
+    scheduler_add_task(state_stream_task, STATE_STREAM_TASK_PERIOD_US);
+#if !LED_USE_CORE1
+    // with LED_USE_CORE1 the pipeline was started on core1 by ws2812_init()
+    scheduler_add_task(led_effect_task, LED_EFFECT_TASK_PERIOD_US);
+    scheduler_add_task(ws2812_update_task, LED_OUTPUT_TASK_PERIOD_US);
+#endif //!LED_USE_CORE1
+
+    scheduler_run();
 
     return 0;
 }
 
+// The effect time base counts effect ticks, so it advances at a fixed rate
+void led_effect_task(void) {
+    static unsigned int t = 0;
+    led_effect_update_task(t++);
+}
+
 //--------------------------------------------------------------------+
 // Device callbacks
 //--------------------------------------------------------------------+
@@ -122,118 +154,388 @@ void tud_resume_cb(void) {
 //--------------------------------------------------------------------+
 // USB CDC
 //--------------------------------------------------------------------+
-void cdc_task(void) {
-    // connected() check for DTR bit
-    // Most but not all terminal client set this when making connection
-    // if ( tud_cdc_connected() )
-    {
-        // connected and there are data available
-        if (tud_cdc_available()) {
-            // read datas
-            uint8_t buf[64];
-            uint32_t count = tud_cdc_read(buf, sizeof(buf));
-            (void) count;
-
-            uint8_t *command_id = &(buf[0]);
-            uint8_t *command_data = &(buf[1]);
-
-            switch (*command_id) {
-                case id_get_protocol_version: {
-                    command_data[0] = COMMAND_PROTOCOL_VERSION >> 8;
-                    command_data[1] = COMMAND_PROTOCOL_VERSION & 0xFF;
+// Multi-byte protocol fields are big endian
+static inline uint16_t get_u16(const uint8_t *data) {
+    return (uint16_t) ((data[0] << 8) | data[1]);
+}
+
+static inline void put_u16(uint8_t *data, uint16_t value) {
+    data[0] = value >> 8;
+    data[1] = value & 0xFF;
+}
+
+static inline void put_u32(uint8_t *data, uint32_t value) {
+    data[0] = (value >> 24) & 0xFF;
+    data[1] = (value >> 16) & 0xFF;
+    data[2] = (value >> 8) & 0xFF;
+    data[3] = value & 0xFF;
+}
+
+//--------------------------------------------------------------------+
+// CONTROLLER STATE STREAM
+//--------------------------------------------------------------------+
+// Largest record: header, timestamp, buttons, every axis and every encoder
+#define STATE_RECORD_MAX_LENGTH (2 + 1 + 2 + 1 + 4 + 4 + 1 + 2 * AXIS_ID_COUNT + 1 + 4 * ENCODER_MAX_COUNT)
+
+static uint8_t state_stream_fields = 0;
+static uint32_t state_stream_period_us = 0;
+static uint32_t state_stream_next_us = 0;
+// Counts every record due, including the ones dropped because the host wasn't reading fast enough
+static uint16_t state_stream_sequence = 0;
+
+static bool state_stream_subscribe(uint8_t fields, uint16_t rate_hz) {
+    if (rate_hz > STATE_STREAM_MAX_RATE_HZ) return false;
+
+    state_stream_fields = fields;
+    state_stream_period_us = rate_hz ? 1000000 / rate_hz : 0;
+    state_stream_next_us = time_us_32();
+    state_stream_sequence = 0;
+    return true;
+}
+
+// Builds a framed record, returns its length
+static uint32_t state_stream_record(uint8_t *record) {
+    uint32_t length = 2;
+    record[length++] = id_controller_state;
+    put_u16(&record[length], state_stream_sequence);
+    length += 2;
+    record[length++] = state_stream_fields;
+
+    if (state_stream_fields & id_state_timestamp) {
+        put_u32(&record[length], time_us_32());
+        length += 4;
+    }
+
+    if (state_stream_fields & id_state_buttons) {
+        put_u32(&record[length], input_get_buttons());
+        length += 4;
+    }
+
+    if (state_stream_fields & id_state_axes) {
+        uint16_t axes[AXIS_ID_COUNT];
+        uint8_t axis_count = input_get_axes(axes);
+        record[length++] = axis_count;
+        for (int i = 0; i < axis_count; ++i) {
+            put_u16(&record[length], axes[i]);
+            length += 2;
+        }
+    }
+
+    if (state_stream_fields & id_state_encoders) {
+        uint32_t count_index = length++;
+        record[count_index] = 0;
+        for (int i = 0; i < ENCODER_MAX_COUNT; ++i) {
+            encoder *enc = encoder_get(i);
+            if (!enc) continue;
+
+            put_u32(&record[length], (uint32_t) encoder_get_count(enc));
+            length += 4;
+            record[count_index]++;
+        }
+    }
+
+    put_u16(record, length - 2);
+    return length;
+}
+
+// Sends a record when one is due, never waits on the host so the HID path isn't held up
+void state_stream_task(void) {
+    // like the command path, DTR isn't required since not every client sets it, the subscription says a host is there
+    if (!state_stream_period_us || !tud_mounted()) return;
+
+    uint32_t now = time_us_32();
+    if ((int32_t) (now - state_stream_next_us) < 0) return;
+
+    state_stream_next_us += state_stream_period_us;
+    // fell more than a period behind, start counting from now instead of bursting
+    if ((int32_t) (now - state_stream_next_us) >= 0) state_stream_next_us = now + state_stream_period_us;
+
+    uint8_t record[STATE_RECORD_MAX_LENGTH];
+    uint32_t length = state_stream_record(record);
+    state_stream_sequence++;
+
+    // records never take the room held for a reply, the sequence gap tells the host a record was dropped
+    if (cdc_tx_free() < length + CDC_REPLY_RESERVE) return;
+    cdc_tx_write(record, length);
+}
+
+//--------------------------------------------------------------------+
+// LED BATCH
+//--------------------------------------------------------------------+
+// Largest batch, bounded by the frame length anyway
+#define LED_BATCH_MAX_FILLS 64
+// Error status for a batch that failed as a whole rather than at one fill, never a fill index
+#define LED_BATCH_REJECTED 0xFF
+
+struct led_fill {
+    uint16_t start_led;
+    uint16_t end_led;
+    uint8_t value;
+    uint8_t *data;
+};
+
+// Bytes of data each lighting value takes
+static uint8_t led_value_length(uint8_t value) {
+    return value == id_led_base_color ? 3 : 1;
+}
+
+// Reads one [selection][selection args][value][value data] fill, returns the bytes it took or 0 if it is invalid
+static uint32_t cdc_parse_led_fill(uint8_t *data, uint32_t length, struct led_fill *fill) {
+    uint32_t used;
+    if (length < 1) return 0;
+
+    switch (data[0]) {
+        case id_single: {
+            if (length < 3) return 0;
+            fill->start_led = fill->end_led = get_u16(&data[1]);
+            used = 3;
+            break;
+        }
+
+        case id_multiple: {
+            if (length < 5) return 0;
+            fill->start_led = get_u16(&data[1]);
+            fill->end_led = get_u16(&data[3]);
+            used = 5;
+            break;
+        }
+
+        case id_section: {
+            if (length < 2 || !ws2812_get_section(data[1], &fill->start_led, &fill->end_led)) return 0;
+            used = 2;
+            break;
+        }
+
+        case id_all: {
+            fill->start_led = 0;
+            fill->end_led = ws2812_get_led_count() - 1;
+            used = 1;
+            break;
+        }
+
+        default:
+            return 0;
+    }
+
+    if (length < used + 1) return 0;
+    fill->value = data[used++];
+    fill->data = &data[used];
+    used += led_value_length(fill->value);
+
+    if (length < used || !ws2812_check_fill(fill->start_led, fill->end_led, fill->value)) return 0;
+    return used;
+}
+
+// Validates every fill before applying any, on success data[0] stays the fill count,
+// on error it is the bad fill or LED_BATCH_REJECTED for an empty, oversized or unqueueable batch
+static bool cdc_led_batch(uint8_t *data, uint32_t length) {
+    struct led_fill fills[LED_BATCH_MAX_FILLS];
+    uint8_t fill_count = length ? data[0] : 0;
+    if (!length || fill_count > LED_BATCH_MAX_FILLS) {
+        data[0] = LED_BATCH_REJECTED;
+        return false;
+    }
+
+    uint32_t offset = 1;
+    for (int i = 0; i < fill_count; ++i) {
+        uint32_t used = cdc_parse_led_fill(&data[offset], length - offset, &fills[i]);
+        if (!used) {
+            data[0] = i;
+            return false;
+        }
+        offset += used;
+    }
+
+    if (!ws2812_batch_begin(fill_count)) {
+        data[0] = LED_BATCH_REJECTED;
+        return false;
+    }
+    for (int i = 0; i < fill_count; ++i) {
+        ws2812_fill_leds(fills[i].start_led, fills[i].end_led, fills[i].value, fills[i].data);
+    }
+    ws2812_batch_end();
+    return true;
+}
+
+// Queues the framed reply, cdc_ready() and the state stream keep CDC_REPLY_RESERVE free for it
+static void cdc_reply(const uint8_t *buf, uint32_t count) {
+    uint8_t header[2];
+    if (cdc_tx_free() < sizeof(header) + count) {
+        // shouldn't happen, but the host still gets a reply for its request
+        static const uint8_t error_reply[3] = {0x00, 0x01, id_error};
+        cdc_tx_write(error_reply, sizeof(error_reply));
+        return;
+    }
+
+    put_u16(header, count);
+    cdc_tx_write(header, sizeof(header));
+    cdc_tx_write(buf, count);
+}
+
+// Handles one framed command, the reply is written over it
+// The buffer is reused between frames, so every command checks its length before reading its arguments
+static void cdc_handle_command(uint8_t *buf, uint16_t length) {
+    uint32_t count = length;
+    if (!count) {
+        // the frame was too long or refused by its sink
+        buf[0] = id_error;
+        cdc_reply(buf, 1);
+        return;
+    }
+
+    uint8_t *command_id = &(buf[0]);
+    uint8_t *command_data = &(buf[1]);
+
+    switch (*command_id) {
+        case id_get_protocol_version: {
+            command_data[0] = COMMAND_PROTOCOL_VERSION >> 8;
+            command_data[1] = COMMAND_PROTOCOL_VERSION & 0xFF;
+            count += 2;
+            break;
+        }
+
+        case id_get_team_number: {
+            command_data[0] = (TEAM_NUMBER >> 24) & 0xFF;
+            command_data[1] = (TEAM_NUMBER >> 16) & 0xFF;
+            command_data[2] = (TEAM_NUMBER >> 8) & 0xFF;
+            command_data[3] = TEAM_NUMBER & 0xFF;
+            count += 4;
+            break;
+        }
+
+        case id_get_controller_state: {
+            // [fields][rate u16 Hz], a rate of 0 ends the subscription, the request is echoed back
+            if (count < 4 || !state_stream_subscribe(command_data[0], get_u16(&command_data[1])))
+                *command_id = id_error;
+            break;
+        }
+
+        case id_get_led_data: {
+            if (count < 2) {
+                *command_id = id_error;
+                break;
+            }
+
+            switch (command_data[0]) {
+                case id_led_count: {
+                    put_u16(&command_data[1], ws2812_get_led_count());
                     count += 2;
                     break;
                 }
 
-                case id_get_team_number: {
-                    command_data[0] = (TEAM_NUMBER >> 24) & 0xFF;
-                    command_data[1] = (TEAM_NUMBER >> 16) & 0xFF;
-                    command_data[2] = (TEAM_NUMBER >> 8) & 0xFF;
-                    command_data[3] = TEAM_NUMBER & 0xFF;
+                case id_section_count: {
+                    command_data[1] = ws2812_get_section_count();
+                    count += 1;
+                    break;
+                }
+
+                case id_section_layout: {
+                    uint16_t start_led, end_led;
+                    if (count < 3 || !ws2812_get_section(command_data[1], &start_led, &end_led)) {
+                        *command_id = id_error;
+                        break;
+                    }
+                    put_u16(&command_data[2], start_led);
+                    put_u16(&command_data[4], end_led);
                     count += 4;
                     break;
                 }
 
-                case id_get_controller_state: {
-                    //TODO Imp
+                case id_frame_timing: {
+                    uint32_t effect_us, render_us, transmit_us;
+                    ws2812_get_frame_timing(&effect_us, &render_us, &transmit_us);
+                    put_u32(&command_data[1], effect_us);
+                    put_u32(&command_data[5], render_us);
+                    put_u32(&command_data[9], transmit_us);
+                    count += 12;
                     break;
                 }
 
-                case id_get_led_data: {
-                    switch (command_data[0]) {
-                        case id_led_count: {
-                            command_data[1] = LED_COUNT;
-                            count += 1;
-                            break;
-                        }
-
-                        case id_section_count: {
-                            command_data[1] = SECTION_COUNT;
-                            count += 1;
-                            break;
-                        }
-
-                        default: {
-                            *command_id = id_error;
-                            break;
-                        }
-                    }
+                default: {
+                    *command_id = id_error;
                     break;
                 }
+            }
+            break;
+        }
+
+        case id_get_led: {
+            //TODO Imp
+            break;
+        }
+
+        case id_set_led: {
+            // same [selection][selection args][value][value data] as a batch fill, checked against the frame length
+            struct led_fill fill;
+            if (!cdc_parse_led_fill(command_data, count - 1, &fill) ||
+                !ws2812_fill_leds(fill.start_led, fill.end_led, fill.value, fill.data))
+                *command_id = id_error;
+            break;
+        }
+
+        case id_set_led_data: {
+            if (count < 2) {
+                *command_id = id_error;
+                break;
+            }
 
-                case id_get_led: {
-                    //TODO Imp
+            switch (command_data[0]) {
+                case id_led_count: {
+                    if (count < 4 || !ws2812_set_led_count(get_u16(&command_data[1])))
+                        *command_id = id_error;
                     break;
                 }
 
-                case id_set_led: {
-                    switch (command_data[0]) {
-                        case id_single: {
-                            if (!ws2812_fill_leds(command_data[1], command_data[1], command_data[2],
-                                                  &(command_data[3])))
-                                *command_id = id_error;
-                            break;
-                        }
-
-                        case id_multiple: {
-                            if (!ws2812_fill_leds(command_data[1], command_data[2], command_data[3],
-                                                  &(command_data[4])))
-                                *command_id = id_error;
-                            break;
-                        }
-
-
-                        case id_section: {
-                            if (!ws2812_fill_section(command_data[1], command_data[2], &(command_data[3])))
-                                *command_id = id_error;
-                            break;
-                        }
-
-                        case id_all: {
-                            if (!ws2812_fill_leds(0, LED_COUNT - 1, command_data[1], &(command_data[2])))
-                                *command_id = id_error;
-                            break;
-                        }
-
-                        default: {
-                            *command_id = id_error;
-                            break;
-                        }
-                    }
+                case id_section_count: {
+                    if (count < 3 || !ws2812_set_section_count(command_data[1]))
+                        *command_id = id_error;
+                    break;
+                }
+
+                case id_section_layout: {
+                    if (count < 7 || !ws2812_set_section(command_data[1], get_u16(&command_data[2]), get_u16(&command_data[4])))
+                        *command_id = id_error;
                     break;
                 }
 
-                case id_get_port_name: {
-                    const char *data = get_string_desc()[4];
-                    strcpy(command_data, data);
-                    count += strlen(data);
+                default: {
+                    *command_id = id_error;
+                    break;
+                }
+            }
+            break;
+        }
+
+        case id_set_timeline: {
+            if (count < 2) {
+                *command_id = id_error;
+                break;
+            }
+
+            switch (command_data[0]) {
+                case id_timeline_keyframe: {
+                    // [section][index][r][g][b][easing][time u16 ms]
+                    if (count < 10 || !ws2812_timeline_set_keyframe(command_data[1], command_data[2], &(command_data[3]),
+                                                                    command_data[6], get_u16(&command_data[7])))
+                        *command_id = id_error;
                     break;
                 }
 
-                case id_enter_bootloader: {
-                    tud_cdc_write(buf, sizeof(buf));
-                    tud_cdc_write_flush();
-                    reset_usb_boot(0, 0);
+                case id_timeline_length: {
+                    if (count < 5 || !ws2812_timeline_set_length(command_data[1], command_data[2], command_data[3]))
+                        *command_id = id_error;
+                    break;
+                }
+
+                case id_timeline_play: {
+                    if (count < 3 || !ws2812_timeline_play(command_data[1]))
+                        *command_id = id_error;
+                    break;
+                }
+
+                case id_timeline_stop: {
+                    if (count < 3 || !ws2812_timeline_stop(command_data[1]))
+                        *command_id = id_error;
                     break;
                 }
 
@@ -242,11 +544,96 @@ void cdc_task(void) {
                     break;
                 }
             }
+            break;
+        }
 
-            tud_cdc_write(buf, count);
-            tud_cdc_write_flush();
+        case id_set_led_batch: {
+            if (!cdc_led_batch(command_data, count - 1))
+                *command_id = id_error;
+            // one status for the whole batch, the fill count, the first bad fill or LED_BATCH_REJECTED
+            count = 2;
+            break;
+        }
+
+        case id_get_port_name: {
+            const char *data = get_string_desc()[4];
+            strcpy(command_data, data);
+            count += strlen(data);
+            break;
+        }
+
+        case id_enter_bootloader: {
+            cdc_reply(buf, count);
+            // the reply has to leave before USB goes down
+            cdc_tx_flush_blocking();
+            reset_usb_boot(0, 0);
+            break;
+        }
+
+        default: {
+            *command_id = id_error;
+            break;
         }
     }
+
+    cdc_reply(buf, count);
+}
+
+//--------------------------------------------------------------------+
+// LED STREAM SINK
+//--------------------------------------------------------------------+
+// An id_stream_frame payload goes straight from the FIFO into the LED buffers, without a reply
+static bool cdc_stream_begin(uint16_t length) {
+    if (length != (uint32_t) ws2812_get_led_count() * 3) return false;
+
+    ws2812_stream_begin();
+    return true;
+}
+
+static void cdc_stream_advance(uint32_t bytes) {
+    ws2812_stream_advance(bytes);
+}
+
+// Compressed frames are any length, the ops end with the payload
+static bool cdc_stream_compressed_begin(uint16_t length) {
+    (void) length;
+    ws2812_stream_compressed_begin();
+    return true;
+}
+
+static const struct frame_sink cdc_sinks[] = {
+        {id_stream_frame,            cdc_stream_begin,            ws2812_stream_window,            cdc_stream_advance,               NULL},
+        {id_stream_frame_compressed, cdc_stream_compressed_begin, ws2812_stream_compressed_window, ws2812_stream_compressed_advance, ws2812_stream_compressed_end},
+};
+
+static struct frame_parser cdc_parser;
+
+static uint32_t cdc_read(void *buffer, uint32_t length) {
+    if (!length) return 0;
+    return tud_cdc_read(buffer, length);
+}
+
+static bool cdc_ready(void) {
+    return cdc_tx_free() >= CDC_REPLY_RESERVE;
+}
+
+void cdc_init(void) {
+    frame_parser_init(&cdc_parser, cdc_read, cdc_handle_command, cdc_ready, cdc_sinks,
+                      sizeof(cdc_sinks) / sizeof(cdc_sinks[0]));
+}
+
+void cdc_task(void) {
+    // connected() check for DTR bit
+    // Most but not all terminal client set this when making connection
+    // if ( tud_cdc_connected() )
+    {
+        // commands can be pipelined, the parser takes whatever part of them has arrived
+        frame_parser_poll(&cdc_parser);
+    }
+
+    // replies from this poll and earlier go out in as few packets as possible,
+    // without waiting for more once the host has nothing else queued
+    cdc_tx_task(!tud_cdc_available());
 }
 
 // Invoked when cdc when line state changed e.g connected/disconnected
@@ -270,16 +657,35 @@ void tud_cdc_rx_cb(uint8_t itf) {
 //--------------------------------------------------------------------+
 // USB HID
 //--------------------------------------------------------------------+
-// Every 10ms, we will sent 1 report for each HID profile (keyboard, mouse etc ..)
+#if HID_LOW_LATENCY
+static uint8_t last_report[HID_REPORT_LENGTH] = {0};
+static bool last_report_valid = false;
+static uint32_t last_report_ms = 0;
+// 0 only reports on change, set by the host with SET_IDLE
+static uint32_t idle_ms = HID_IDLE_KEEPALIVE_MS;
+
+// Sends a report if the inputs differ from the last one sent or the idle period ran out
+static void hid_report_if_changed(void) {
+    if (!tud_hid_ready()) return; // a report is in flight, its completion chains the next one
+
+    uint8_t report[HID_REPORT_LENGTH] = {0};
+    update_report(report);
+
+    bool changed = !last_report_valid || memcmp(report, last_report, sizeof(report));
+    bool idle_expired = idle_ms && (board_millis() - last_report_ms >= idle_ms);
+    if (!changed && !idle_expired) return;
+
+    if (tud_hid_report(REPORT_ID_GAMEPAD, &report, sizeof(report))) {
+        memcpy(last_report, report, sizeof(report));
+        last_report_valid = true;
+        last_report_ms = board_millis();
+    }
+}
+#endif //HID_LOW_LATENCY
+
+// Every HID_TASK_PERIOD_US, we will sent 1 report for each HID profile (keyboard, mouse etc ..)
 // tud_hid_report_complete_cb() is used to send the next report after previous one is complete
 void hid_task(void) {
-    // Poll every 10ms
-    const uint32_t interval_ms = 10;
-    static uint32_t start_ms = 0;
-
-    if (board_millis() - start_ms < interval_ms) return; // not enough time
-    start_ms += interval_ms;
-
     uint32_t const btn = board_button_read();
 
     // Remote wakeup
@@ -288,6 +694,9 @@ void hid_task(void) {
         // and REMOTE_WAKEUP feature is enabled by host
         tud_remote_wakeup();
     } else {
+#if HID_LOW_LATENCY
+        hid_report_if_changed();
+#else
         // skip if hid is not ready yet
         if (!tud_hid_ready()) {
             return;
@@ -297,6 +706,7 @@ void hid_task(void) {
         update_report(report);
 
         tud_hid_report(REPORT_ID_GAMEPAD, &report, sizeof(report));
+#endif //HID_LOW_LATENCY
     }
 }
 
@@ -305,9 +715,25 @@ void hid_task(void) {
 // Note: For composite reports, report[0] is report ID
 void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint8_t len) {
     (void) instance;
+    (void) report;
     (void) len;
 
-    uint8_t next_report_id = report[0] + 1;
+#if HID_LOW_LATENCY
+    // the endpoint is free again, send whatever changed while the last report was in flight
+    hid_report_if_changed();
+#endif //HID_LOW_LATENCY
+}
+
+// Invoked when received SET_IDLE request, idle_rate is in 4 ms units and 0 means only report on change
+bool tud_hid_set_idle_cb(uint8_t instance, uint8_t idle_rate) {
+    (void) instance;
+
+#if HID_LOW_LATENCY
+    idle_ms = (uint32_t) idle_rate * 4;
+#else
+    (void) idle_rate;
+#endif //HID_LOW_LATENCY
+    return true;
 }
 
 // Invoked when received GET_REPORT control request
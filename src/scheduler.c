@@ -0,0 +1,70 @@
+#include "scheduler.h"
+
+static scheduler_task tasks[SCHEDULER_MAX_TASKS];
+static uint8_t task_count = 0;
+
+int scheduler_add_task(scheduler_fn fn, uint32_t period_us) {
+    if (task_count >= SCHEDULER_MAX_TASKS) return -1;
+
+    scheduler_task *task = &tasks[task_count];
+    task->fn = fn;
+    task->period_us = period_us;
+    task->next_us = time_us_64() + period_us;
+    task->runs = 0;
+    task->overruns = 0;
+    task->max_jitter_us = 0;
+
+    return task_count++;
+}
+
+const scheduler_task *scheduler_get_task(uint8_t id) {
+    if (id >= task_count) return NULL;
+    return &tasks[id];
+}
+
+uint8_t scheduler_task_count(void) {
+    return task_count;
+}
+
+// Runs every task that is due and then sleeps until the next deadline or an interrupt
+void scheduler_run_once(void) {
+    uint64_t next_deadline = UINT64_MAX;
+
+    for (int i = 0; i < task_count; ++i) {
+        scheduler_task *task = &tasks[i];
+
+        if (task->period_us) {
+            uint64_t now = time_us_64();
+            if (now < task->next_us) {
+                if (task->next_us < next_deadline) next_deadline = task->next_us;
+                continue;
+            }
+
+            uint64_t late = now - task->next_us;
+            if (late > task->max_jitter_us) task->max_jitter_us = late > UINT32_MAX ? UINT32_MAX : (uint32_t) late;
+
+            if (late >= task->period_us) {
+                // missed at least one whole period, don't try to catch up with a burst of runs
+                task->overruns++;
+                task->next_us = now + task->period_us;
+            } else {
+                task->next_us += task->period_us;
+            }
+
+            if (task->next_us < next_deadline) next_deadline = task->next_us;
+        }
+
+        task->fn();
+        task->runs++;
+    }
+
+    // USB and other interrupts wake the core early, so period 0 tasks still run promptly
+    if (next_deadline != UINT64_MAX)
+        best_effort_wfe_or_timeout(from_us_since_boot(next_deadline));
+}
+
+void scheduler_run(void) {
+    while (1) {
+        scheduler_run_once();
+    }
+}
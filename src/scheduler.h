@@ -0,0 +1,36 @@
+#ifndef SCHEDULER
+#define SCHEDULER
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "pico/time.h"
+
+#define SCHEDULER_MAX_TASKS 12
+
+typedef void (*scheduler_fn)(void);
+
+struct scheduler_task {
+    scheduler_fn fn;
+    // 0 runs the task on every pass, for work driven by interrupts (USB)
+    uint32_t period_us;
+    uint64_t next_us;
+    uint32_t runs;
+    // times the task started a whole period or more late and its deadline was resynced
+    uint32_t overruns;
+    // worst start lateness seen, in us
+    uint32_t max_jitter_us;
+};
+
+typedef struct scheduler_task scheduler_task;
+
+int scheduler_add_task(scheduler_fn fn, uint32_t period_us);
+
+const scheduler_task *scheduler_get_task(uint8_t id);
+
+uint8_t scheduler_task_count(void);
+
+void scheduler_run_once(void);
+
+void scheduler_run(void);
+
+#endif //SCHEDULER
@@ -0,0 +1,88 @@
+#include <string.h>
+#include "stream_decoder.h"
+
+// Copies length bytes from the previous frame, black without one
+static void stream_copy_previous(struct stream_decoder *decoder, uint32_t length) {
+    uint8_t *out = &decoder->frame[decoder->offset];
+    if (decoder->previous) {
+        memcpy(out, &decoder->previous[decoder->offset], length);
+    } else {
+        memset(out, 0, length);
+    }
+    decoder->offset += length;
+}
+
+void stream_decoder_begin(struct stream_decoder *decoder, uint8_t *frame, const uint8_t *previous, uint32_t length) {
+    decoder->state = stream_decode_op;
+    decoder->frame = frame;
+    decoder->previous = previous;
+    decoder->length = length;
+    decoder->offset = 0;
+}
+
+uint8_t *stream_decoder_window(struct stream_decoder *decoder, uint32_t *space) {
+    switch (decoder->state) {
+        case stream_decode_run_color:
+            *space = 3 - decoder->color_received;
+            return &decoder->color[decoder->color_received];
+
+        case stream_decode_literal:
+            *space = decoder->remaining;
+            return &decoder->frame[decoder->offset];
+
+        case stream_decode_op:
+        default:
+            *space = 1;
+            return &decoder->op;
+    }
+}
+
+void stream_decoder_advance(struct stream_decoder *decoder, uint32_t bytes) {
+    switch (decoder->state) {
+        case stream_decode_op: {
+            uint8_t op = decoder->op;
+            // ops running past the last LED are cut short
+            uint32_t length = ((op & 0x80 ? op & 0x3F : op & 0x7F) + 1) * 3;
+            if (length > decoder->length - decoder->offset) length = decoder->length - decoder->offset;
+
+            if (!(op & 0x80)) {
+                decoder->remaining = length;
+                if (length) decoder->state = stream_decode_literal;
+            } else if (!(op & 0x40)) {
+                decoder->remaining = length;
+                decoder->color_received = 0;
+                decoder->state = stream_decode_run_color;
+            } else {
+                stream_copy_previous(decoder, length);
+            }
+            break;
+        }
+
+        case stream_decode_run_color: {
+            decoder->color_received += bytes;
+            if (decoder->color_received < 3) break;
+
+            uint8_t *out = &decoder->frame[decoder->offset];
+            for (uint32_t i = 0; i < decoder->remaining; i += 3) {
+                out[i + 0] = decoder->color[0];
+                out[i + 1] = decoder->color[1];
+                out[i + 2] = decoder->color[2];
+            }
+            decoder->offset += decoder->remaining;
+            decoder->state = stream_decode_op;
+            break;
+        }
+
+        case stream_decode_literal: {
+            decoder->offset += bytes;
+            decoder->remaining -= bytes;
+            if (!decoder->remaining) decoder->state = stream_decode_op;
+            break;
+        }
+    }
+}
+
+// The payload ended, whatever the ops didn't cover stays as it was
+void stream_decoder_end(struct stream_decoder *decoder) {
+    stream_copy_previous(decoder, decoder->length - decoder->offset);
+}
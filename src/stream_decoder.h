@@ -0,0 +1,42 @@
+#ifndef STREAM_DECODER
+#define STREAM_DECODER
+
+#include <stdint.h>
+
+// Decoder for compressed LED frames, kept free of pico headers so the host tests can build it.
+// A compressed frame is a list of ops, each a header byte:
+//  0x00-0x7F  literal, (n & 0x7F) + 1 RGB LEDs follow
+//  0x80-0xBF  run, the RGB that follows repeats for (n & 0x3F) + 1 LEDs
+//  0xC0-0xFF  skip, (n & 0x3F) + 1 LEDs keep the previous frame's color
+// LEDs after the last op are skipped too. It is decoded as it arrives, literals are read straight into place.
+
+enum stream_decode_state {
+    stream_decode_op = 0,
+    stream_decode_run_color = 1,
+    stream_decode_literal = 2
+};
+
+struct stream_decoder {
+    enum stream_decode_state state;
+    uint8_t op;
+    uint8_t color[3];
+    uint8_t color_received;
+    // LEDs the current op still covers, in bytes for a literal
+    uint32_t remaining;
+    // frame being written and the one skipped LEDs come from, NULL for black
+    uint8_t *frame;
+    const uint8_t *previous;
+    // bytes in a frame and bytes already written
+    uint32_t length;
+    uint32_t offset;
+};
+
+void stream_decoder_begin(struct stream_decoder *decoder, uint8_t *frame, const uint8_t *previous, uint32_t length);
+
+uint8_t *stream_decoder_window(struct stream_decoder *decoder, uint32_t *space);
+
+void stream_decoder_advance(struct stream_decoder *decoder, uint32_t bytes);
+
+void stream_decoder_end(struct stream_decoder *decoder);
+
+#endif //STREAM_DECODER
@@ -385,7 +385,7 @@ uint8_t const desc_fs_configuration[] =
 
                 // Interface number, string index, protocol, report descriptor len, EP In address, size & polling interval
                 TUD_HID_DESCRIPTOR(ITF_NUM_HID, 5, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), EPNUM_HID_IN,
-                                   CFG_TUD_HID_EP_BUFSIZE, 5)
+                                   CFG_TUD_HID_EP_BUFSIZE, HID_POLL_INTERVAL_MS)
         };
 
 #if TUD_OPT_HIGH_SPEED
@@ -25,8 +25,26 @@
 #ifndef USB_DESCRIPTORS_H_
 #define USB_DESCRIPTORS_H_
 
+#include "config.h"
+
 const char** get_string_desc();
 
+#ifndef HID_LOW_LATENCY
+#define HID_LOW_LATENCY false
+#endif //HID_LOW_LATENCY
+
+// Default keepalive until the host sends SET_IDLE, 0 only reports on change
+#ifndef HID_IDLE_KEEPALIVE_MS
+#define HID_IDLE_KEEPALIVE_MS 0
+#endif //HID_IDLE_KEEPALIVE_MS
+
+// HID endpoint bInterval in ms
+#if HID_LOW_LATENCY
+#define HID_POLL_INTERVAL_MS 1
+#else
+#define HID_POLL_INTERVAL_MS 5
+#endif //HID_LOW_LATENCY
+
 enum {
     REPORT_ID_GAMEPAD = 1,
     REPORT_ID_COUNT
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "color.h"
+
+// The float conversion hue_wheel and hsl_to_rgb replaced, kept as the reference
+static float hueToRGB(float p, float q, float t) {
+    if (t < 0) t += 1;
+    if (t > 1) t -= 1;
+    if (t < (float) 1 / 6) return p + (q - p) * 6 * t;
+    if (t < (float) 1 / 2) return q;
+    if (t < (float) 2 / 3) return p + (q - p) * ((float) 2 / 3 - t) * 6;
+    return p;
+}
+
+static uint32_t hslToRGB(float h, float s, float l) {
+    float r, g, b;
+
+    if (s == 0) {
+        r = g = b = l; // achromatic
+    } else {
+        float q = (l < 0.5) ? l * (1 + s) : l + s - l * s;
+        float p = 2 * l - q;
+        r = hueToRGB(p, q, h + (float) 1 / 3);
+        g = hueToRGB(p, q, h);
+        b = hueToRGB(p, q, h - (float) 1 / 3);
+    }
+
+    return
+            ((uint32_t) (r * 255) << 16) |
+            ((uint32_t) (g * 255) << 8) |
+            (uint32_t) (b * 255);
+}
+
+// Largest difference between any channel of two 0xRRGGBB colors
+static int channel_error(uint32_t a, uint32_t b) {
+    int worst = 0;
+    for (int shift = 0; shift <= 16; shift += 8) {
+        int error = abs((int) ((a >> shift) & 0xFF) - (int) ((b >> shift) & 0xFF));
+        if (error > worst) worst = error;
+    }
+    return worst;
+}
+
+int main(void) {
+    int failures = 0;
+
+    // the wheel is the old path exactly
+    for (int h = 0; h < 256; ++h) {
+        uint32_t expected = hslToRGB((float) h / 255, 1, 0.5f);
+        if (hue_wheel[h] != expected || hsl_to_rgb(h, 0xFF, 0x80) != expected) {
+            printf("hue %d: 0x%06X, expected 0x%06X\n", h, hue_wheel[h], expected);
+            failures++;
+        }
+    }
+
+    // everywhere else within 1 of it, on a grid that includes both ends of s and l
+    for (int h = 0; h < 256; ++h) {
+        for (int s = 0; s < 256; s += 5) {
+            for (int l = 0; l < 256; l += 5) {
+                uint32_t expected = hslToRGB((float) h / 255, (float) s / 255, (float) l / 255);
+                uint32_t actual = hsl_to_rgb(h, s, l);
+                if (channel_error(actual, expected) > 1) {
+                    printf("hsl %d %d %d: 0x%06X, expected 0x%06X\n", h, s, l, actual, expected);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    if (failures) {
+        printf("%d colors off\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "framing.h"
+
+// Feeds a stream of frames through the parser in random sized reads and checks that every frame comes out once,
+// in order and intact, however the reads split or merge them
+
+#define EVENT_COUNT 1000
+#define SINK_ID 0xEE
+#define SINK_LENGTH 300
+// oversized frames are up to 400 bytes past FRAME_MAX_LENGTH, plus the length and id
+#define STREAM_SIZE (EVENT_COUNT * (FRAME_MAX_LENGTH + 400 + 3))
+
+enum event_type {
+    event_handled = 0,
+    event_dropped = 1,
+    event_sink = 2
+};
+
+struct event {
+    enum event_type type;
+    uint32_t offset;
+    uint16_t length;
+};
+
+static uint8_t stream[STREAM_SIZE];
+static uint32_t stream_length;
+static uint32_t stream_read;
+// bytes the next poll may still read, like a USB FIFO holding part of the stream
+static uint32_t available;
+
+static struct event expected[EVENT_COUNT];
+static int expected_count;
+static int seen_count;
+static int failures;
+
+static bool ready_result = true;
+
+static uint8_t sink_buffer[SINK_LENGTH];
+static uint32_t sink_received;
+
+static void fail(const char *message) {
+    if (failures++ < 10) printf("event %d: %s\n", seen_count, message);
+}
+
+static const struct event *next_event(enum event_type type) {
+    if (seen_count >= expected_count) {
+        fail("more events than frames");
+        return NULL;
+    }
+
+    const struct event *event = &expected[seen_count++];
+    if (event->type != type) {
+        fail("wrong event type");
+        return NULL;
+    }
+    return event;
+}
+
+static uint32_t test_read(void *buffer, uint32_t length) {
+    if (length > available) length = available;
+    if (length > stream_length - stream_read) length = stream_length - stream_read;
+
+    memcpy(buffer, &stream[stream_read], length);
+    stream_read += length;
+    available -= length;
+    return length;
+}
+
+static void test_handler(uint8_t *payload, uint16_t length) {
+    const struct event *event = next_event(length ? event_handled : event_dropped);
+    if (!event || !length) return;
+
+    if (event->length != length || memcmp(payload, &stream[event->offset], length))
+        fail("handled payload differs");
+}
+
+static bool test_ready(void) {
+    return ready_result;
+}
+
+static bool sink_begin(uint16_t length) {
+    sink_received = 0;
+    // a sink refusing a frame has it discarded like an oversized one
+    return length == SINK_LENGTH;
+}
+
+static uint8_t *sink_window(uint32_t *space) {
+    // smaller than the frame, so the parser has to come back for more
+    *space = 50;
+    if (*space > SINK_LENGTH - sink_received) *space = SINK_LENGTH - sink_received;
+    return &sink_buffer[sink_received];
+}
+
+static void sink_advance(uint32_t bytes) {
+    sink_received += bytes;
+}
+
+static void sink_end(void) {
+    const struct event *event = next_event(event_sink);
+    if (!event) return;
+
+    if (sink_received != SINK_LENGTH || memcmp(sink_buffer, &stream[event->offset], SINK_LENGTH))
+        fail("sink payload differs");
+}
+
+static const struct frame_sink sinks[] = {
+        {SINK_ID, sink_begin, sink_window, sink_advance, sink_end},
+};
+
+static void put_frame(uint16_t length, uint8_t id, enum event_type type) {
+    stream[stream_length++] = length >> 8;
+    stream[stream_length++] = length & 0xFF;
+
+    struct event *event = &expected[expected_count++];
+    event->type = type;
+    // the id is the first payload byte for the handler, the sink only gets what follows it
+    event->offset = stream_length + (type == event_sink ? 1 : 0);
+    event->length = length;
+
+    if (length) stream[stream_length++] = id;
+    for (int i = 1; i < length; ++i) stream[stream_length++] = rand();
+}
+
+static void build_stream(void) {
+    stream_length = 0;
+    expected_count = 0;
+
+    while (expected_count < EVENT_COUNT) {
+        int kind = rand() % 10;
+        if (kind == 0) {
+            put_frame(SINK_LENGTH + 1, SINK_ID, event_sink);
+        } else if (kind == 1) {
+            // refused by the sink
+            put_frame(SINK_LENGTH, SINK_ID, event_dropped);
+        } else if (kind == 2) {
+            // too long for the buffer
+            put_frame(FRAME_MAX_LENGTH + 1 + rand() % 400, 0x01, event_dropped);
+        } else if (kind == 3) {
+            put_frame(0, 0, event_dropped);
+        } else {
+            put_frame(1 + rand() % FRAME_MAX_LENGTH, 0x01 + rand() % 0x80, event_handled);
+        }
+    }
+}
+
+// max_read of 0 hands the whole stream over at once
+static void run(const char *name, uint32_t max_read, bool hold_off) {
+    struct frame_parser parser;
+    frame_parser_init(&parser, test_read, test_handler, test_ready, sinks, sizeof(sinks) / sizeof(sinks[0]));
+
+    build_stream();
+    stream_read = 0;
+    seen_count = 0;
+    int before = failures;
+
+    while (stream_read < stream_length) {
+        available = max_read ? rand() % (max_read + 1) : stream_length;
+
+        // a parser that isn't ready must not start on the next frame, the bytes stay with the source
+        ready_result = !hold_off || rand() % 4;
+        uint32_t read_before = stream_read;
+        bool at_boundary = parser.state == frame_length_high;
+        frame_parser_poll(&parser);
+        if (!ready_result && at_boundary && stream_read != read_before) fail("read while not ready");
+    }
+    ready_result = true;
+    available = 0;
+    frame_parser_poll(&parser);
+
+    if (seen_count != expected_count) fail("frames missing");
+    if (parser.state != frame_length_high) fail("parser left inside a frame");
+    printf("%s: %s\n", name, failures == before ? "ok" : "failed");
+}
+
+int main(void) {
+    srand(467);
+
+    run("one byte at a time", 1, false);
+    run("random splits", 70, false);
+    run("large merged reads", 2000, false);
+    run("whole stream", 0, false);
+    run("held off while not ready", 70, true);
+
+    return failures ? 1 : 0;
+}
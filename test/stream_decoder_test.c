@@ -0,0 +1,129 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream_decoder.h"
+
+// Decodes random compressed frames fed in random sized pieces and compares them with decoding the whole payload at once
+
+#define MAX_LEDS 300
+#define FRAME_COUNT 2000
+#define GUARD 0xA5
+#define GUARD_SIZE 64
+
+static uint8_t payload[MAX_LEDS * 4 * 4];
+static uint32_t payload_length;
+
+// Whole payload reference, ops stop mattering once the frame is full
+static void reference_decode(uint8_t *out, const uint8_t *previous, uint32_t length) {
+    uint32_t offset = 0;
+    uint32_t i = 0;
+
+    while (i < payload_length && offset < length) {
+        uint8_t op = payload[i++];
+        uint32_t bytes = ((op & 0x80 ? op & 0x3F : op & 0x7F) + 1) * 3;
+        if (bytes > length - offset) bytes = length - offset;
+
+        if (!(op & 0x80)) {
+            memcpy(&out[offset], &payload[i], bytes);
+            i += bytes;
+        } else if (!(op & 0x40)) {
+            for (uint32_t j = 0; j < bytes; j += 3) memcpy(&out[offset + j], &payload[i], 3);
+            i += 3;
+        } else if (previous) {
+            memcpy(&out[offset], &previous[offset], bytes);
+        } else {
+            memset(&out[offset], 0, bytes);
+        }
+        offset += bytes;
+    }
+
+    // LEDs after the last op keep the previous frame
+    if (previous) {
+        memcpy(&out[offset], &previous[offset], length - offset);
+    } else {
+        memset(&out[offset], 0, length - offset);
+    }
+}
+
+// Ops covering about coverage LEDs, past the end of the frame when coverage is larger than it
+static void build_payload(uint32_t coverage) {
+    payload_length = 0;
+    uint32_t covered = 0;
+
+    while (covered < coverage) {
+        int kind = rand() % 3;
+        if (kind == 0) {
+            uint8_t count = rand() % 0x80;
+            payload[payload_length++] = count;
+            for (int i = 0; i < (count + 1) * 3; ++i) payload[payload_length++] = rand();
+            covered += count + 1;
+        } else if (kind == 1) {
+            uint8_t count = rand() % 0x40;
+            payload[payload_length++] = 0x80 | count;
+            for (int i = 0; i < 3; ++i) payload[payload_length++] = rand();
+            covered += count + 1;
+        } else {
+            uint8_t count = rand() % 0x40;
+            payload[payload_length++] = 0xC0 | count;
+            covered += count + 1;
+        }
+    }
+}
+
+int main(void) {
+    static uint8_t previous[MAX_LEDS * 3];
+    static uint8_t expected[MAX_LEDS * 3];
+    static uint8_t frame[MAX_LEDS * 3 + GUARD_SIZE];
+    int failures = 0;
+
+    srand(467);
+
+    for (int f = 0; f < FRAME_COUNT; ++f) {
+        uint32_t leds = 1 + rand() % MAX_LEDS;
+        uint32_t length = leds * 3;
+        // half short of the frame, half running past its last LED
+        build_payload(rand() % (leds * 2 + 1));
+
+        for (uint32_t i = 0; i < length; ++i) previous[i] = rand();
+        const uint8_t *source = f % 5 ? previous : NULL;
+        reference_decode(expected, source, length);
+
+        memset(frame, GUARD, sizeof(frame));
+        struct stream_decoder decoder;
+        stream_decoder_begin(&decoder, frame, source, length);
+
+        uint32_t fed = 0;
+        while (fed < payload_length) {
+            uint32_t space;
+            uint8_t *window = stream_decoder_window(&decoder, &space);
+
+            uint32_t count = 1 + rand() % 40;
+            if (count > space) count = space;
+            if (count > payload_length - fed) count = payload_length - fed;
+            if (!count) continue;
+
+            memcpy(window, &payload[fed], count);
+            stream_decoder_advance(&decoder, count);
+            fed += count;
+        }
+        stream_decoder_end(&decoder);
+
+        bool guard_intact = true;
+        for (int i = 0; i < GUARD_SIZE; ++i) guard_intact &= frame[length + i] == GUARD;
+
+        if (memcmp(frame, expected, length) || !guard_intact) {
+            if (failures < 10) {
+                printf("frame %d, %u LEDs, %u payload bytes: %s\n", f, leds, payload_length,
+                       guard_intact ? "differs" : "written past the last LED");
+            }
+            failures++;
+        }
+    }
+
+    if (failures) {
+        printf("%d frames off\n", failures);
+        return 1;
+    }
+    return 0;
+}